@@ -12,6 +12,34 @@
 #include <linux/interrupt.h>            // Required for the IRQ code
 #include <linux/kthread.h>
 #include <linux/delay.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>           // Required for the /dev/ebbgpio character device
+#include <linux/kfifo.h>
+#include <linux/poll.h>
+#include <linux/uio.h>
+#include <linux/uaccess.h>
+#include <linux/io_uring/cmd.h>         // Required for the IORING_OP_URING_CMD passthrough
+#include <linux/anon_inodes.h>          // Required for the line request file descriptors
+#include <linux/file.h>
+#include <linux/rculist.h>
+#include <linux/slab.h>
+#include <linux/log2.h>
+#include <linux/gpio/consumer.h>        // Required for the bulk gpiod reads of the capture mode
+#include <linux/hrtimer.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/firmware.h>             // Required for the boot configuration blob
+#include <linux/crc32.h>
+#include <net/genetlink.h>              // Required for the multicast event family
+#include <linux/workqueue.h>
+#include <linux/xarray.h>              // Required for the shared pattern library
+#include <linux/kref.h>
+#include <linux/pwm.h>                  // Required for the hardware blinking offload
+#include <linux/spi/spi.h>              // Required for the WS2812 SPI-MOSI output path
+#include <linux/mod_devicetable.h>
+#include <linux/crc-ccitt.h>            // Required for the optical link framing
+#include "ebbgpio.h"                    // The user-space interface shared with applications
+#include "ebbgpio_instance.h"           // The per-instance state, also timed by ebbgpioctl bench-layout
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("SONU VERMA");
@@ -22,38 +50,2777 @@ static unsigned int gpioLedRED = 		66;       	///< hard coding the LED gpio for
 static unsigned int gpioLedGREEN = 		67;		// gpio assgined to the GREEN LED 
 static unsigned int gpioButton = 		69;   		///< hard coding the button gpio for this example to P9_27 (GPIO115)
 static unsigned int irqNumber;          			///< Used to share the IRQ number within this file
-static unsigned int numberPresses = 		0;  		///< For information, store the number of button presses
 static bool	    currentStateLedRED = 	1;     		///< Is the LED on or off? Used to invert its state (off by default)
 static bool         currentStateLedGREEN = 	0;
-static bool 	    ledOn = 			0;
-enum modes           				{OFF, ON, FLASH}; 
 static struct task_struct *task;
-static enum modes mode = 			FLASH;	        ///< Default mode is flashing
-static unsigned int blinkPeriod = 		1000;		///< The blink period in ms
+
+#define BLINK_CATCHUP_MAX			4		///< Larger backlogs are skipped even when catching up
+#define BLINK_DEGRADE_MAX			3		///< Slowest degraded rate is 1/8 of the configured one
+#define BLINK_RECOVER_TOGGLES			16		///< On time toggles before a degraded rate steps back up
+
+/** @brief A pattern of the shared library, read-only once published
+ *  The library holds one reference and every instance playing it one more. Lookups run under
+ *  RCU, so the memory is only freed a grace period after the last reference is gone.
+ */
+struct ebb_pattern {
+   struct kref ref;
+   struct rcu_head rcu;
+   u32 id;
+   u32 periodMs;				///< Sum of the frame durations
+   u32 numFrames;
+   struct ebbgpio_frame frames[];
+};
+
+static struct ebb_instance ebb = {
+   .mode = FLASH,
+   .blinkPeriod = 1000,
+   .blinkOverrun = EBBGPIO_OVERRUN_SKIP,
+   .blinkLateUs = 1000,
+};
+module_param_array_named(blinkSlackUs, ebb.blinkSlackUs, uint, NULL, S_IRUGO);
+MODULE_PARM_DESC(blinkSlackUs, " Blink timing tolerance per LED in us, lets toggles coalesce with other timers (default=0,0)");
+module_param_named(blinkOverrun, ebb.blinkOverrun, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(blinkOverrun, " After a missed toggle: 0 skip and stay in phase, 1 catch up, 2 degrade the rate (default=0)");
+module_param_named(blinkLateUs, ebb.blinkLateUs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(blinkLateUs, " Toggle lateness in us, on top of the slack, counted as a missed deadline (default=1000)");
+static unsigned int sloUs[EBBGPIO_LAT_NUM] = 	{0, 0};		///< p99 objective per enum ebbgpio_latency_metric
+module_param_array(sloUs, uint, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sloUs, " p99 objective in us for button-to-LED latency and blink lateness, 0 to not monitor (default=0,0)");
+static unsigned int sloWindowMs = 		1000;		///< Length of one SLO evaluation window
+module_param(sloWindowMs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sloWindowMs, " Length of an SLO evaluation window in ms (default=1000)");
+static unsigned int sloWindows = 		3;		///< Windows in a row above the SLO before an alarm
+module_param(sloWindows, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sloWindows, " Consecutive windows above the SLO that raise an alarm event (default=3)");
+/// One client's LED request, see ebbgpio_post_request()
+struct ebbgpio_arb_slot {
+   struct timer_list expiry;                    ///< Withdraws the request when it times out
+   unsigned long expires;                       ///< jiffies of the timeout, 0 for none
+   enum modes mode;
+   unsigned int period;                         ///< Blink period in ms
+   u8 priority;
+   bool active;
+};
+static struct ebbgpio_arb_slot arbSlots[EBBGPIO_MAX_CLIENTS];
+static u32 arbPrioMask;							///< Bit p set while any request has priority p
+static u16 arbPrioClients[EBBGPIO_MAX_PRIORITY + 1];			///< Per priority, the clients requesting it
+static unsigned int arbWinner;						///< Client whose request is shown
+static DEFINE_SPINLOCK(arbLock);					///< Protects the arbitration state above
+static unsigned int idleTimeoutS = 		0;		///< Seconds without input before the idle pattern, 0 never
+module_param(idleTimeoutS, uint, S_IRUGO);
+MODULE_PARM_DESC(idleTimeoutS, " Seconds without a button press before the LEDs go to the idle pattern, 0 to disable (default=0)");
+static unsigned int idleMode = 			EBBGPIO_MODE_OFF;	///< enum ebbgpio_mode shown while idle
+module_param(idleMode, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(idleMode, " LED mode while idle: 0 off, 1 on, 2 flash at idleBlinkPeriod (default=0)");
+static unsigned int idleBlinkPeriod = 		6000;		///< Slow blink period in ms for an idle FLASH
+module_param(idleBlinkPeriod, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(idleBlinkPeriod, " Blink period in ms of the idle pattern (default=6000)");
+static struct timer_list idleTimer;					///< Checks for inactivity, re-armed lazily
+static unsigned long idleEntries;
+static char *pwmRED;							///< "provider:index" of a PWM driving the RED LED
+module_param(pwmRED, charp, S_IRUGO);
+MODULE_PARM_DESC(pwmRED, " PWM chip and channel wired to the RED LED, e.g. 48302200.pwm:0 (default=none)");
+static char *pwmGREEN;							///< "provider:index" of a PWM driving the GREEN LED
+module_param(pwmGREEN, charp, S_IRUGO);
+MODULE_PARM_DESC(pwmGREEN, " PWM chip and channel wired to the GREEN LED (default=none)");
+static unsigned int ledDutyPercent = 		100;		///< Brightness of a PWM-backed LED in ON mode
+module_param(ledDutyPercent, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(ledDutyPercent, " Duty cycle of PWM-backed LEDs in ON mode, for dimming (default=100)");
+static struct pwm_device *ledPwm[2];					///< PWM channel per LED, NULL for software blinking
+static struct pwm_lookup ledPwmLookup[2];
+static int gpioStrip = 				-1;		///< GPIO bit-banging a WS2812 strip, -1 for none
+module_param(gpioStrip, int, S_IRUGO);
+MODULE_PARM_DESC(gpioStrip, " GPIO driving a WS2812 strip when no SPI output is bound (default=-1, none)");
+static unsigned int stripPixels = 		0;		///< Length of the WS2812 strip, 0 disables the engine
+module_param(stripPixels, uint, S_IRUGO);
+MODULE_PARM_DESC(stripPixels, " Number of WS2812 pixels, up to 1024 (default=0, no strip)");
+static unsigned int stripLength = 		0;		///< Pixels sent per frame, 0 for all of stripPixels
+module_param(stripLength, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(stripLength, " Pixels sent per frame, for a shorter strip or a benchmark, 0 for stripPixels (default=0)");
+#define WS2812_MAX_PIXELS			1024
+#define WS2812_T0H_NS				400		///< High time of a 0 bit
+#define WS2812_T1H_NS				800		///< High time of a 1 bit
+#define WS2812_BIT_NS				1250		///< 800 kHz bit period
+#define WS2812_RESET_US				300		///< Low time that latches a frame (WS2812B needs >280us)
+#define WS2812_SPI_HZ				2400000		///< Three SPI bits per WS2812 bit
+#define WS2812_SPI_RESET_BYTES			90		///< 300us of low MOSI at WS2812_SPI_HZ
+static u8 *stripBack;							///< Frame written by user space, G R B per pixel
+static u8 *stripFront;							///< Frame being sent
+static u8 *stripSpiBuf;							///< SPI encoding of the front frame
+static bool stripDirty;							///< The back frame differs from what was last sent
+static DEFINE_MUTEX(stripLock);						///< Protects stripBack and stripDirty
+static DEFINE_MUTEX(stripTxLock);					///< Protects stripFront and the outputs while sending
+static struct gpio_desc *stripDesc;					///< Bit-banged output, NULL when unused
+static struct spi_device *stripSpi;					///< SPI output, preferred when bound
+static u8 ws2812SpiCode[256][3];					///< SPI bit pattern of every data byte
+static unsigned long stripFrames;					///< Frames sent
+static u64 stripFrameNs, stripFrameNsTotal;				///< Wall time of sending, the wait for SPI included
+static u64 stripCpuNs, stripCpuNsTotal;					///< CPU time of encoding or bit-banging
+static void ebbgpio_strip_work(struct work_struct *work);
+static DECLARE_WORK(stripWork, ebbgpio_strip_work);
+static struct workqueue_struct *stripWq;				///< Frames are sent here, not on system_wq
+static int vlcTxLed = 				-1;		///< LED used as optical transmitter, -1 for none
+module_param(vlcTxLed, int, S_IRUGO);
+MODULE_PARM_DESC(vlcTxLed, " LED line transmitting the optical link, 0=RED 1=GREEN (default=-1, none)");
+static int gpioVlcRx = 				-1;		///< Photodiode input of the optical link, -1 for none
+module_param(gpioVlcRx, int, S_IRUGO);
+MODULE_PARM_DESC(gpioVlcRx, " GPIO with the photodiode receiving the optical link (default=-1, none)");
+static unsigned int vlcBitUs = 			1000;		///< Bit period of the optical link
+module_param(vlcBitUs, uint, S_IRUGO);
+MODULE_PARM_DESC(vlcBitUs, " Bit period of the optical link in us, at least 50 (default=1000)");
+#define VLC_MIN_BIT_US				50
+#define VLC_MAX_PAYLOAD				64		///< Payload bytes per frame
+#define VLC_SFD					0xD5		///< Start of frame delimiter after the 0x55 preamble
+#define VLC_GAP_HALVES				8		///< Dark half bits between frames
+enum vlcRxStates				{VLC_RX_HUNT, VLC_RX_LENGTH, VLC_RX_DATA};
+static DEFINE_KFIFO(vlcTxFifo, u8, 1024);				///< Bytes written to /dev/ebbvlc, not yet framed
+static DEFINE_KFIFO(vlcRxFifo, u8, 1024);				///< Payload of good frames, read from /dev/ebbvlc
+static DECLARE_WAIT_QUEUE_HEAD(vlcTxWait);
+static DECLARE_WAIT_QUEUE_HEAD(vlcRxWait);
+static DEFINE_MUTEX(vlcWriteLock);					///< Single producer for vlcTxFifo
+static DEFINE_MUTEX(vlcReadLock);					///< Single consumer for vlcRxFifo
+static struct hrtimer vlcTxTimer;					///< Clocks out one half bit per expiry
+static unsigned long vlcTxBusy;						///< Bit 0 set while vlcTxTimer runs
+static u8 vlcTxFrame[VLC_MAX_PAYLOAD + 6];
+static unsigned int vlcTxLen, vlcTxHalf;				///< Frame bytes, and half bits sent of it
+static u8 vlcRxFrame[VLC_MAX_PAYLOAD + 3];				///< Length, payload and CRC being received
+static unsigned int vlcRxPos, vlcRxBits, vlcRxShift;
+static enum vlcRxStates vlcRxState;
+static bool vlcRxLevel, vlcRxMidBit;					///< Line level, and whether the last edge was mid bit
+static u64 vlcRxLastNs;							///< Timestamp of the previous edge
+static unsigned long vlcTxFrames, vlcRxFrames, vlcRxErrors, vlcRxDropped;
+static bool vlcEnabled;
+static char *configBlob = 			"ebbgpio.bin";	///< Firmware file applied at load time
+module_param(configBlob, charp, S_IRUGO);
+MODULE_PARM_DESC(configBlob, " Firmware file with the boot configuration, empty to skip (default=ebbgpio.bin)");
+
+#define EVENT_FIFO_SIZE				64		///< Number of events queued for /dev/ebbgpio, power of 2
+#define EVENT_FIFO_MAX				4096		///< Largest queue a line request may ask for
+
+/// An event queue with its own lock, wait queue and wakeup policy
+struct ebbgpio_queue {
+   spinlock_t lock;                             ///< Serialises the IRQ producer and the readers
+   wait_queue_head_t wait;                      ///< Readers and pollers sleep here
+   unsigned int wakeupEvents;                   ///< Readers are only woken once this many events are queued
+   unsigned long dropped;                       ///< Events lost because nobody read them in time
+   unsigned long gapPending;                    ///< Drops not yet reported to the reader with a gap record
+   DECLARE_KFIFO_PTR(fifo, struct ebbgpio_event);
+};
+
+/// A subset of lines requested through EBBGPIO_IOC_LINE_REQUEST, owned by its file descriptor
+struct ebbgpio_line_req {
+   struct list_head node;                       ///< Entry in lineReqs, walked under RCU by the producer
+   u64 lines;                                   ///< Bitmask of enum ebbgpio_line
+   u32 eventTypes;                              ///< Bitmask of (1 << enum ebbgpio_event_type)
+   struct ebbgpio_queue queue;
+};
+
+static atomic_t lineSeq[EBBGPIO_MAX_LINES];				///< Last sequence number given out per line
+static struct ebbgpio_queue devQueue;					///< The device-wide stream read through /dev/ebbgpio
+static struct ebbgpio_queue nlQueue;					///< Events waiting to be multicast over generic netlink
+static struct genl_family ebbgpio_genl_family;
+static struct miscdevice ebbgpio_misc;
+static void ebbgpio_queue_event(u32 line, u32 type, u32 value);
+static void ebbgpio_genl_work(struct work_struct *work);
+static DECLARE_WORK(nlWork, ebbgpio_genl_work);				///< Builds and sends the netlink batches
+static unsigned long nlConfigChanged;					///< Bit 0 set when a config notification is due
+static LIST_HEAD(lineReqs);						///< All open line requests
+static DEFINE_MUTEX(lineReqLock);					///< Serialises updates of lineReqs
+
+/// The GPIO behind each enum ebbgpio_line
+static unsigned int *const lineGpio[EBBGPIO_NUM_LINES] = {
+   [EBBGPIO_LINE_RED]    = &gpioLedRED,
+   [EBBGPIO_LINE_GREEN]  = &gpioLedGREEN,
+   [EBBGPIO_LINE_BUTTON] = &gpioButton,
+};
+
+static bool touchSense;							///< The button line is a capacitive touch pad
+module_param(touchSense, bool, S_IRUGO);
+MODULE_PARM_DESC(touchSense, " Sense a touch pad on the button line by its RC charge time instead of edges (default=N)");
+static int touchPads[EBBGPIO_TOUCH_MAX_PADS - 1];			///< Extra pad GPIOs, pad n + 1
+static unsigned int touchNumExtra;
+module_param_array(touchPads, int, &touchNumExtra, S_IRUGO);
+MODULE_PARM_DESC(touchPads, " Up to three more touch pad GPIOs, scanned together with the button line (default=none)");
+static unsigned int touchScanHz = 		50;		///< Scans of all pads per second
+module_param(touchScanHz, uint, S_IRUGO);
+MODULE_PARM_DESC(touchScanHz, " Touch pad scan rate in Hz (default=50)");
+static unsigned int touchThresholdPct = 	30;		///< Charge time increase over the baseline that is a touch
+module_param(touchThresholdPct, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(touchThresholdPct, " Touch threshold as a percentage above the untouched charge time (default=30)");
+#define TOUCH_MAX_LOOPS				10000		///< Upper bound of touchMaxLoops, a few ms with interrupts off
+static unsigned int touchMaxLoops = 		2000;		///< Bounds the time spent with interrupts off per scan
+
+/// Writes of touchMaxLoops are clamped to 1..TOUCH_MAX_LOOPS, as the scan runs with interrupts off
+static int ebbgpio_touch_loops_set(const char *val, const struct kernel_param *kp){
+   unsigned int n;
+   int ret = kstrtouint(val, 0, &n);
+
+   if (ret) return ret;
+   WRITE_ONCE(*(unsigned int *)kp->arg, clamp(n, 1U, (unsigned int)TOUCH_MAX_LOOPS));
+   return 0;
+}
+
+static const struct kernel_param_ops ebbgpio_touch_loops_ops = {
+   .set = ebbgpio_touch_loops_set,
+   .get = param_get_uint,
+};
+module_param_cb(touchMaxLoops, &ebbgpio_touch_loops_ops, &touchMaxLoops, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(touchMaxLoops, " Longest charge time measured, in read loops, at most 10000 (default=2000)");
+#define TOUCH_DISCHARGE_US			5		///< Time the pads are shorted to ground before a scan
+#define TOUCH_FRAC				8		///< Fraction bits of the fixed point baselines
+#define TOUCH_BASE_SHIFT			5		///< Baselines follow 1/32 of the difference per scan
+#define TOUCH_DEBOUNCE				2		///< Consecutive scans needed to change state
+
+/// One touch pad, all charge times in read loops
+struct ebbgpio_touch_pad {
+   u32 raw;                                     ///< Charge time of the last scan
+   u32 base;                                    ///< Untouched charge time, fixed point, 0 until the first scan
+   u64 idleNs;                                  ///< When the pad was last seen untouched
+   u8 count;                                    ///< Scans in a row disagreeing with touched
+   bool touched;
+};
+static struct gpio_desc *touchDescs[EBBGPIO_TOUCH_MAX_PADS];		///< In pad order, read with one bulk call
+static struct ebbgpio_touch_pad touchPad[EBBGPIO_TOUCH_MAX_PADS];
+static unsigned int touchNumPads;
+static struct task_struct *touchTask;					///< The scanning kthread
+static unsigned long touchScans;
+static u64 touchScanNsTotal, touchScanNsMax, touchLatencyNs;
+
+static int sonarTrig[EBBGPIO_SONAR_MAX];				///< Trigger output GPIO per ultrasonic sensor
+static unsigned int sonarNumTrig;
+module_param_array(sonarTrig, int, &sonarNumTrig, S_IRUGO);
+MODULE_PARM_DESC(sonarTrig, " Trigger GPIOs of up to four HC-SR04 style sensors (default=none)");
+static int sonarEcho[EBBGPIO_SONAR_MAX];				///< Echo input GPIO per ultrasonic sensor
+static unsigned int sonarNumEcho;
+module_param_array(sonarEcho, int, &sonarNumEcho, S_IRUGO);
+MODULE_PARM_DESC(sonarEcho, " Echo GPIOs, one per trigger GPIO and in the same order (default=none)");
+static unsigned int sonarSlotMs = 		60;		///< Time each sensor has alone, longer than any echo
+module_param(sonarSlotMs, uint, S_IRUGO);
+MODULE_PARM_DESC(sonarSlotMs, " Time given to each sensor in turn, so echoes of one never reach another (default=60)");
+static unsigned int sonarMaxMm = 		4000;		///< Echoes beyond this range count as timeouts
+module_param(sonarMaxMm, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sonarMaxMm, " Longest distance reported in mm (default=4000)");
+static unsigned int sonarSoundMmS = 		343000;		///< Speed of sound, 343 m/s at 20 C
+module_param(sonarSoundMmS, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sonarSoundMmS, " Speed of sound in mm/s, to compensate for temperature (default=343000)");
+#define SONAR_TRIGGER_US			10		///< Trigger pulse width the sensors expect
+
+enum sonarStates { SONAR_IDLE, SONAR_ARMED, SONAR_ECHO };
+static struct ebbgpio_sonar sonar[EBBGPIO_SONAR_MAX];			///< Results, under sonarLock
+static enum sonarStates sonarState;					///< Of the sensor owning the current slot
+static unsigned int sonarActive;					///< Sensor owning the current slot
+static u64 sonarRiseNs, sonarTrigNs;					///< Echo start and trigger start in this slot
+static ktime_t sonarSlot;						///< Start of the current slot
+static bool sonarTrigHigh;
+static struct hrtimer sonarTimer;					///< Fires the triggers, one slot after the other
+static DEFINE_SPINLOCK(sonarLock);					///< Serialises sonarTimer and the echo IRQs
+static u64 sonarTriggers, sonarLateTotal, sonarLateMax, sonarPulseMax, sonarStray;
+static unsigned int sonarNum;						///< Sensors in use, 0 when the engine is off
+
+static unsigned int captureBufKiB = 		256;		///< Size of the mmap-able capture buffer
+module_param(captureBufKiB, uint, S_IRUGO);
+MODULE_PARM_DESC(captureBufKiB, " Size of the logic-analyzer capture buffer in KiB (default=256)");
+static unsigned int captureMaxRate = 		200000;		///< Highest sample rate accepted, in Hz
+module_param(captureMaxRate, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(captureMaxRate, " Highest logic-analyzer sample rate in Hz (default=200000)");
+static void *captureBuf;						///< struct ebbgpio_capture_header followed by the records
+static struct task_struct *captureTask;					///< The sampling kthread, NULL when idle
+static DEFINE_MUTEX(captureLock);					///< Serialises capture start and stop
+static struct gpio_desc *captureDescs[EBBGPIO_CAPTURE_MAX_LINES];	///< Lines sampled, in line order
+static unsigned int captureNumLines;
 /// Function prototype for the custom IRQ handler function -- see below for the implementation
 static irq_handler_t  ebbgpio_irq_handler(unsigned int irq, void *dev_id, struct pt_regs *regs);
 
 
-/** @brief The LED Flasher main kthread loop
- *
- *  @param arg A void pointer used in order to pass data to the thread
+/** @brief The tolerance the LED thread may use when it sleeps between toggles
+ *  Both LEDs are toggled together, so the tighter of the two per LED tolerances wins.
+ *  @return the slack in ns
+ */
+static u64 ebbgpio_blink_slack_ns(void){
+   return (u64)min(READ_ONCE(ebb.blinkSlackUs[EBBGPIO_LINE_RED]), READ_ONCE(ebb.blinkSlackUs[EBBGPIO_LINE_GREEN])) * NSEC_PER_USEC;
+}
+
+/** @brief Sleep until an absolute deadline of the LED thread, called in TASK_INTERRUPTIBLE
+ *  A wake up with ledGen still at gen changed nothing the LEDs show, so the thread goes back to
+ *  sleep until the same deadline. It neither toggles nor restarts the phase, and the toggle keeps
+ *  the slack it had to coalesce with other timers.
+ *  @return true when the deadline was reached, false when woken for a change or to stop
+ */
+static bool ebbgpio_sleep_until(ktime_t *next, unsigned int gen){
+   while (schedule_hrtimeout_range(next, ebbgpio_blink_slack_ns(), HRTIMER_MODE_ABS)){
+      set_current_state(TASK_INTERRUPTIBLE);
+      if (atomic_read(&ebb.ledGen) != gen || kthread_should_stop() || kthread_should_park()){
+         __set_current_state(TASK_RUNNING);
+         return false;
+      }
+      ebb.blinkWakeups++;				// Still a wake up, for power accounting
+   }
+   return true;
+}
+
+/** @brief Bucket of a latency in the sketch
+ *  Values below 8 ns have a bucket each, above that every power of two is split in 8.
+ */
+static unsigned int ebb_sketch_bucket(u64 ns){
+   unsigned int e;
+
+   if (ns < BIT(SKETCH_SUB_BITS)) return ns;
+   e = fls64(ns) - 1;
+   return min_t(u64, (e - SKETCH_SUB_BITS + 1) << SKETCH_SUB_BITS | ((ns >> (e - SKETCH_SUB_BITS)) & (BIT(SKETCH_SUB_BITS) - 1)),
+                SKETCH_BUCKETS - 1);
+}
+
+/// Middle of the range of values a bucket holds
+static u64 ebb_sketch_value(unsigned int b){
+   unsigned int e = (b >> SKETCH_SUB_BITS) + SKETCH_SUB_BITS - 1;
+   u64 low;
+
+   if (b < BIT(SKETCH_SUB_BITS)) return b;
+   low = (u64)(BIT(SKETCH_SUB_BITS) | (b & (BIT(SKETCH_SUB_BITS) - 1))) << (e - SKETCH_SUB_BITS);
+   return low + (BIT_ULL(e - SKETCH_SUB_BITS) >> 1);
+}
+
+static void ebb_sketch_add(struct ebb_sketch *s, u64 ns){
+   unsigned int b;
+
+   s->count[ebb_sketch_bucket(ns)]++;
+   if (++s->total < SKETCH_DECAY) return;
+   s->total = 0;
+   for (b = 0; b < SKETCH_BUCKETS; b++){
+      s->count[b] /= 2;
+      s->total += s->count[b];
+   }
+}
+
+/** @brief Estimate a quantile from a sketch
+ *  @param q the quantile in parts per 10000, e.g. 9900 for p99
+ *  @return the estimate in ns, 0 for an empty sketch
+ */
+static u64 ebb_sketch_quantile(const struct ebb_sketch *s, unsigned int q){
+   u64 rank, seen = 0;
+   unsigned int b;
+
+   if (!s->total) return 0;
+   rank = max_t(u64, DIV_ROUND_UP_ULL((u64)s->total * q, 10000), 1);
+   for (b = 0; b < SKETCH_BUCKETS; b++){
+      seen += READ_ONCE(s->count[b]);
+      if (seen >= rank) break;
+   }
+   return ebb_sketch_value(min(b, SKETCH_BUCKETS - 1U));
+}
+
+/** @brief Record one latency sample, and check the SLO each time a window closes
+ *  Only the LED thread records samples, so no locking is needed. An alarm event goes out once
+ *  the p99 of sloWindows windows in a row is above the objective, and a clear event with the
+ *  first window back within it.
+ */
+static void ebbgpio_latency_add(unsigned int metric, u64 ns){
+   static const u32 alarmLine[EBBGPIO_LAT_NUM] = {
+      [EBBGPIO_LAT_EDGE]  = EBBGPIO_LINE_BUTTON,
+      [EBBGPIO_LAT_TIMER] = EBBGPIO_LINE_RED,
+   };
+   struct ebb_latency *l = &ebb.lat[metric];
+   unsigned int slo = READ_ONCE(sloUs[metric]);
+   u64 now = ktime_get_ns(), p99;
+
+   if (now - l->windowStart >= (u64)READ_ONCE(sloWindowMs) * NSEC_PER_MSEC){
+      if (slo && l->window.total){
+         p99 = ebb_sketch_quantile(&l->window, 9900);
+         if (p99 > (u64)slo * NSEC_PER_USEC) l->streak++;
+         else l->streak = 0;
+         if (!l->alarmed && l->streak >= max(READ_ONCE(sloWindows), 1U)){
+            WRITE_ONCE(l->alarmed, true);
+            WRITE_ONCE(l->alarms, l->alarms + 1);
+            ebbgpio_queue_event(alarmLine[metric], EBBGPIO_EVENT_SLO_ALARM, min_t(u64, div_u64(p99, NSEC_PER_USEC), U32_MAX));
+         }
+         else if (l->alarmed && !l->streak){
+            WRITE_ONCE(l->alarmed, false);
+            ebbgpio_queue_event(alarmLine[metric], EBBGPIO_EVENT_SLO_CLEAR, div_u64(p99, NSEC_PER_USEC));
+         }
+      }
+      memset(&l->window, 0, sizeof(l->window));
+      l->windowStart = now;
+   }
+   ebb_sketch_add(&l->window, ns);
+   ebb_sketch_add(&l->all, ns);
+   WRITE_ONCE(l->samples, l->samples + 1);
+}
+
+/** @brief Account for how late the LED thread woke for a deadline, a toggle or a pattern frame
+ *  A wake up later than the slack plus blinkLateUs is a miss. On time ones work off a degraded rate.
+ *  @param deadline the deadline that just expired
+ *  @return how late the thread is in ns if it is a miss, otherwise 0
+ */
+static u64 ebbgpio_deadline_miss(ktime_t deadline){
+   s64 late = ktime_to_ns(ktime_sub(ktime_get(), deadline));
+   u64 lateUs;
+
+   if (late < 0) late = 0;
+   lateUs = div_u64(late, NSEC_PER_USEC);
+   ebb.blinkDeadlines++;
+   ebb.blinkLateHist[lateUs ? min(fls64(lateUs), EBBGPIO_LATE_BUCKETS - 1) : 0]++;
+   if (late > ebb.blinkLateMaxNs) ebb.blinkLateMaxNs = late;
+   ebbgpio_latency_add(EBBGPIO_LAT_TIMER, late);
+
+   if (late <= ebbgpio_blink_slack_ns() + (u64)READ_ONCE(ebb.blinkLateUs) * NSEC_PER_USEC){
+      if (ebb.blinkDegradeShift && ++ebb.blinkOnTime >= BLINK_RECOVER_TOGGLES){
+         ebb.blinkDegradeShift--;
+         ebb.blinkOnTime = 0;
+      }
+      return 0;
+   }
+   ebb.blinkMisses++;
+   ebb.blinkLateTotalNs += late;
+   ebb.blinkOnTime = 0;
+   return late;
+}
+
+/** @brief Account for how late the LED thread woke for a toggle and pick the next deadline
+ *  Called right after a timed sleep expired, before the toggle is done. blinkOverrun decides how
+ *  the thread gets back on track after a miss.
+ *  @param next the deadline that just expired, advanced to the following one
+ *  @param halfNs time between two toggles at the configured rate
+ */
+static void ebbgpio_blink_deadline(ktime_t *next, u64 halfNs){
+   u64 late = ebbgpio_deadline_miss(*next), missed;
+
+   if (!late){
+      *next = ktime_add_ns(*next, halfNs << ebb.blinkDegradeShift);
+      return;
+   }
+   missed = div64_u64(late, halfNs);				// Whole toggles slept through
+   switch (READ_ONCE(ebb.blinkOverrun)){
+   case EBBGPIO_OVERRUN_CATCHUP:
+      if (missed <= BLINK_CATCHUP_MAX){
+         *next = ktime_add_ns(*next, halfNs);		// Already due, so the next toggles follow back to back
+         break;
+      }
+      fallthrough;
+   default:
+   case EBBGPIO_OVERRUN_SKIP:
+      if (missed & 1) ebb.ledOn = !ebb.ledOn;		// The caller toggles once more, which lands in phase
+      ebb.blinkSkipped += missed;
+      *next = ktime_add_ns(*next, (missed + 1) * halfNs);
+      break;
+   case EBBGPIO_OVERRUN_DEGRADE:
+      if (ebb.blinkDegradeShift < BLINK_DEGRADE_MAX) ebb.blinkDegradeShift++;
+      *next = ktime_add_ns(ktime_get(), halfNs << ebb.blinkDegradeShift);
+      break;
+   }
+}
+
+/** @brief The pattern frame counterpart of ebbgpio_blink_deadline()
+ *  Called right after the sleep for a frame expired, before the next frame is fetched. Frames
+ *  already due play back to back (CATCHUP), the pattern finds its place from the clock (SKIP) or
+ *  plays on from now at a slower rate (DEGRADE, the caller stretches the frames).
+ *  @param next the deadline that just expired, moved to where the next frame starts
+ *  @param frameNs length of the frame that just ended
+ *  @return true when the caller has to find the frame from the clock
+ */
+static bool ebbgpio_frame_deadline(ktime_t *next, u64 frameNs){
+   u64 late = ebbgpio_deadline_miss(*next);
+
+   if (!late) return false;
+   switch (READ_ONCE(ebb.blinkOverrun)){
+   case EBBGPIO_OVERRUN_CATCHUP:
+      if (div64_u64(late, frameNs) <= BLINK_CATCHUP_MAX) return false;
+      fallthrough;
+   default:
+   case EBBGPIO_OVERRUN_SKIP:
+      *next = ktime_get();
+      return true;
+   case EBBGPIO_OVERRUN_DEGRADE:
+      if (ebb.blinkDegradeShift < BLINK_DEGRADE_MAX) ebb.blinkDegradeShift++;
+      *next = ktime_get();
+      return false;
+   }
+}
+
+/** @brief Wake the LED thread so that a mode, period or pattern change takes effect at once
+ *  Without this a steady LED would never notice, since the thread sleeps until it is woken.
+ *  Only call it on a real change, every call costs the thread a wake up.
+ */
+static void ebbgpio_kick_thread(void){
+   struct task_struct *t = READ_ONCE(task);
+
+   smp_mb__before_atomic();                 // The change is seen by whoever sees the new ledGen
+   atomic_inc(&ebb.ledGen);
+   if (!IS_ERR_OR_NULL(t)) wake_up_process(t);
+}
+
+/** @brief Resolve the effective LED output from the posted requests, called with arbLock held
+ *  The highest priority with a request is found with one fls() on the priority bitmap and the
+ *  winning client at that priority with one __ffs(), so the cost does not grow with the clients.
+ *  @return true when the winner, mode or period changed, only then is the LED thread woken
+ */
+static bool ebbgpio_arb_resolve(void){
+   struct ebbgpio_arb_slot *s;
+   unsigned int prio, winner;
+   bool changed;
+
+   if (!arbPrioMask){                       // Only possible before the config request is posted
+      changed = ebb.mode != OFF;
+      WRITE_ONCE(ebb.mode, OFF);
+      return changed;
+   }
+   prio = fls(arbPrioMask) - 1;
+   winner = __ffs(arbPrioClients[prio]);
+   s = &arbSlots[winner];
+   changed = winner != arbWinner || s->mode != ebb.mode || s->period != ebb.blinkPeriod;
+   arbWinner = winner;
+   WRITE_ONCE(ebb.blinkPeriod, s->period);
+   WRITE_ONCE(ebb.mode, s->mode);
+   return changed;
+}
+
+/// Take a client's request out of the priority bitmap, called with arbLock held
+static void ebbgpio_arb_unlink(unsigned int client){
+   struct ebbgpio_arb_slot *s = &arbSlots[client];
+
+   if (!s->active) return;
+   arbPrioClients[s->priority] &= ~BIT(client);
+   if (!arbPrioClients[s->priority]) arbPrioMask &= ~BIT(s->priority);
+   s->active = false;
+}
+
+/** @brief Post, replace or withdraw the LED request of one client
+ *  Safe to call from any context, including the IRQ handler. A request with a timeout is
+ *  withdrawn by its own timer when it expires, nothing polls for it.
+ *  @param client EBBGPIO_CLIENT_* or a client id of the caller's choosing below EBBGPIO_MAX_CLIENTS
+ *  @param priority 0 to EBBGPIO_MAX_PRIORITY, the highest priority request is shown
+ *  @param reqMode the enum ebbgpio_mode requested
+ *  @param periodMs blink period for EBBGPIO_MODE_FLASH, must be non-zero
+ *  @param timeoutMs the request expires after this many ms, 0 keeps it until replaced
+ *  @return returns 0 if successful, -EINVAL for bad arguments
+ */
+int ebbgpio_post_request(unsigned int client, unsigned int priority, u32 reqMode, unsigned int periodMs, unsigned int timeoutMs){
+   struct ebbgpio_arb_slot *s;
+   unsigned long flags;
+   bool changed;
+
+   if (client >= EBBGPIO_MAX_CLIENTS || priority > EBBGPIO_MAX_PRIORITY ||
+       reqMode > EBBGPIO_MODE_FLASH || periodMs == 0)
+      return -EINVAL;
+   s = &arbSlots[client];
+   spin_lock_irqsave(&arbLock, flags);
+   ebbgpio_arb_unlink(client);
+   s->priority = priority;
+   s->mode = (enum modes)reqMode;
+   s->period = periodMs;
+   s->expires = timeoutMs ? jiffies + msecs_to_jiffies(timeoutMs) : 0;
+   s->active = true;
+   arbPrioClients[priority] |= BIT(client);
+   arbPrioMask |= BIT(priority);
+   if (timeoutMs) mod_timer(&s->expiry, s->expires);
+   changed = ebbgpio_arb_resolve();
+   spin_unlock_irqrestore(&arbLock, flags);
+   if (changed) ebbgpio_kick_thread();           // A repeated or outranked request leaves the LEDs alone
+   return 0;
+}
+EXPORT_SYMBOL_GPL(ebbgpio_post_request);
+
+/** @brief Withdraw a client's request, the next lower request takes over
+ *  @return returns 0 if successful, -EINVAL for a bad client
+ */
+int ebbgpio_clear_request(unsigned int client){
+   unsigned long flags;
+   bool changed;
+
+   if (client >= EBBGPIO_MAX_CLIENTS) return -EINVAL;
+   spin_lock_irqsave(&arbLock, flags);
+   ebbgpio_arb_unlink(client);
+   changed = ebbgpio_arb_resolve();
+   spin_unlock_irqrestore(&arbLock, flags);
+   if (changed) ebbgpio_kick_thread();
+   return 0;
+}
+EXPORT_SYMBOL_GPL(ebbgpio_clear_request);
+
+/** @brief Post a request if the client has none, otherwise withdraw it
+ *  Used by the button, whose presses switch its request on and off.
+ */
+static void ebbgpio_toggle_request(unsigned int client, unsigned int priority, u32 reqMode){
+   unsigned long flags;
+   bool active;
+
+   spin_lock_irqsave(&arbLock, flags);
+   active = arbSlots[client].active;
+   spin_unlock_irqrestore(&arbLock, flags);
+   if (active) ebbgpio_clear_request(client);
+   else ebbgpio_post_request(client, priority, reqMode, READ_ONCE(ebb.blinkPeriod), 0);
+}
+
+/** @brief Expiry timer of a request
+ *  The request may have been replaced since the timer was armed, so only an active request
+ *  whose deadline has passed is withdrawn.
+ */
+static void ebbgpio_arb_expire(struct timer_list *t){
+   struct ebbgpio_arb_slot *s = container_of(t, struct ebbgpio_arb_slot, expiry);
+   unsigned long flags;
+   bool changed = false;
+
+   spin_lock_irqsave(&arbLock, flags);
+   if (s->active && s->expires && time_after_eq(jiffies, s->expires)){
+      ebbgpio_arb_unlink(s - arbSlots);
+      changed = ebbgpio_arb_resolve();
+   }
+   spin_unlock_irqrestore(&arbLock, flags);
+   if (changed) ebbgpio_kick_thread();
+}
+
+/** @brief Post the idle request once the button has been left alone for idleTimeoutS
+ *  Presses only store a timestamp, so the timer is not touched on every edge. When it fires
+ *  early because of a press since it was armed, it is simply pushed out to the new deadline.
+ */
+static void ebbgpio_idle_expire(struct timer_list *t){
+   unsigned long timeout = (unsigned long)idleTimeoutS * HZ;
+   unsigned long due = READ_ONCE(ebb.lastInput) + timeout;
+
+   if (time_before(jiffies, due)){
+      mod_timer(&idleTimer, due);
+      return;
+   }
+   if (test_and_set_bit(0, &ebb.idleActive)) return;
+   ebbgpio_post_request(EBBGPIO_CLIENT_IDLE, EBBGPIO_PRIO_IDLE, min(READ_ONCE(idleMode), (unsigned int)EBBGPIO_MODE_FLASH),
+                        max(READ_ONCE(idleBlinkPeriod), 1U), 0);
+   idleEntries++;
+   // A press racing with the bit above may have missed it, so look at the timestamp once more
+   if (time_before(jiffies, READ_ONCE(ebb.lastInput) + timeout) && test_and_clear_bit(0, &ebb.idleActive)){
+      ebbgpio_clear_request(EBBGPIO_CLIENT_IDLE);
+      mod_timer(&idleTimer, READ_ONCE(ebb.lastInput) + timeout);
+   }
+}
+
+/** @brief Note some input, leaving the idle pattern if it is shown
+ *  Called from the IRQ handler. Only the first press after an idle period does any real work.
+ */
+static void ebbgpio_idle_input(void){
+   WRITE_ONCE(ebb.lastInput, jiffies);
+   smp_mb();						// Pairs with test_and_set_bit() in ebbgpio_idle_expire()
+   if (test_bit(0, &ebb.idleActive) && test_and_clear_bit(0, &ebb.idleActive)){
+      ebbgpio_clear_request(EBBGPIO_CLIENT_IDLE);
+      mod_timer(&idleTimer, jiffies + (unsigned long)idleTimeoutS * HZ);
+   }
+}
+
+/// Set up the request slots and post the default configuration as the lowest request
+static void ebbgpio_arb_init(void){
+   unsigned int i;
+
+   for (i = 0; i < EBBGPIO_MAX_CLIENTS; i++) timer_setup(&arbSlots[i].expiry, ebbgpio_arb_expire, 0);
+   ebbgpio_post_request(EBBGPIO_CLIENT_CONFIG, EBBGPIO_PRIO_CONFIG, ebb.mode, ebb.blinkPeriod, 0);
+   timer_setup(&idleTimer, ebbgpio_idle_expire, 0);
+   ebb.lastInput = jiffies;
+   if (idleTimeoutS) mod_timer(&idleTimer, jiffies + (unsigned long)idleTimeoutS * HZ);
+}
+
+/// Stop the expiry timers, nothing may post requests any more
+static void ebbgpio_arb_exit(void){
+   unsigned int i;
+
+   timer_shutdown_sync(&idleTimer);
+   for (i = 0; i < EBBGPIO_MAX_CLIENTS; i++) timer_shutdown_sync(&arbSlots[i].expiry);
+}
+
+/** @brief Parse a "provider:index" PWM parameter and register a lookup for it
+ *  @return returns 0 if successful
+ */
+static int ebbgpio_pwm_lookup(unsigned int led, char *spec){
+   struct pwm_lookup *l = &ledPwmLookup[led];
+   char *sep = strrchr(spec, ':');
+   unsigned int index;
+
+   if (!sep || sep == spec || kstrtouint(sep + 1, 0, &index)) return -EINVAL;
+   l->provider = kstrndup(spec, sep - spec, GFP_KERNEL);
+   if (!l->provider) return -ENOMEM;
+   l->index = index;
+   l->dev_id = ebbgpio_misc.name;           // dev_name() of the misc device
+   l->con_id = led == EBBGPIO_LINE_RED ? "red" : "green";
+   l->period = NSEC_PER_MSEC;
+   l->polarity = PWM_POLARITY_NORMAL;
+   pwm_add_table(l, 1);
+   return 0;
+}
+
+/** @brief Attach the LEDs that have a PWM channel
+ *  Any failure only means that LED stays on the software engine.
+ */
+static void ebbgpio_pwm_init(void){
+   char *spec[2] = { [EBBGPIO_LINE_RED] = pwmRED, [EBBGPIO_LINE_GREEN] = pwmGREEN };
+   struct pwm_device *pwm;
+   unsigned int led;
+   int ret;
+
+   for (led = EBBGPIO_LINE_RED; led <= EBBGPIO_LINE_GREEN; led++){
+      if (!spec[led] || !*spec[led]) continue;
+      ret = ebbgpio_pwm_lookup(led, spec[led]);
+      if (ret){
+         printk(KERN_WARNING "GPIO_TEST: bad PWM '%s': %d\n", spec[led], ret);
+         continue;
+      }
+      pwm = pwm_get(ebbgpio_misc.this_device, ledPwmLookup[led].con_id);
+      if (IS_ERR(pwm)){
+         printk(KERN_WARNING "GPIO_TEST: PWM '%s' unavailable, using software blinking: %ld\n", spec[led], PTR_ERR(pwm));
+         continue;
+      }
+      ledPwm[led] = pwm;
+      printk(KERN_INFO "GPIO_TEST: %s LED offloaded to PWM '%s'\n", ledPwmLookup[led].con_id, spec[led]);
+   }
+}
+
+/** @brief Program the PWM-backed LEDs for a mode
+ *  FLASH becomes a 50% duty cycle with the same on and off times the software engine uses, ON
+ *  a fast PWM at ledDutyPercent for dimming, OFF disables the output.
+ */
+static void ebbgpio_pwm_apply(enum modes m, unsigned int periodMs){
+   struct pwm_state st;
+   unsigned int led;
+
+   for (led = EBBGPIO_LINE_RED; led <= EBBGPIO_LINE_GREEN; led++){
+      if (!ledPwm[led]) continue;
+      pwm_init_state(ledPwm[led], &st);
+      if (m == FLASH){
+         st.period = 2ULL * max(periodMs / 3, 1U) * NSEC_PER_MSEC;
+         st.duty_cycle = st.period / 2;
+      } else {
+         st.period = NSEC_PER_MSEC;
+         st.duty_cycle = m == ON ? div_u64(st.period * min(READ_ONCE(ledDutyPercent), 100U), 100) : 0;
+      }
+      st.enabled = m != OFF;
+      if (pwm_apply_might_sleep(ledPwm[led], &st))
+         printk(KERN_WARNING "GPIO_TEST: cannot program the %s PWM\n", ledPwmLookup[led].con_id);
+   }
+}
+
+/// True when the software engine drives this LED, rather than a PWM or the optical link
+static bool ebbgpio_led_sw(unsigned int led){
+   return !ledPwm[led] && vlcTxLed != (int)led;
+}
+
+/// Turn off and release the PWM channels, the LED thread is already stopped
+static void ebbgpio_pwm_exit(void){
+   unsigned int led;
+
+   ebbgpio_pwm_apply(OFF, 0);
+   for (led = EBBGPIO_LINE_RED; led <= EBBGPIO_LINE_GREEN; led++){
+      if (ledPwm[led]){
+         pwm_put(ledPwm[led]);
+         ledPwm[led] = NULL;
+      }
+      if (ledPwmLookup[led].provider){
+         pwm_remove_table(&ledPwmLookup[led], 1);
+         kfree(ledPwmLookup[led].provider);
+         ledPwmLookup[led].provider = NULL;
+      }
+   }
+}
+
+static DEFINE_XARRAY(patterns);						///< The shared pattern library, by id
+static DEFINE_MUTEX(patternLock);					///< Serialises changes of ebb.pattern and the library
+static unsigned int patternCount;					///< Patterns in the library
+static size_t patternBytes;						///< Memory of the patterns in the library
+static unsigned int patternMax = 		64;		///< Bounds the memory user space can pin
+module_param(patternMax, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(patternMax, " Most patterns the shared library holds (default=64)");
+
+static void ebb_pattern_release(struct kref *ref){
+   struct ebb_pattern *p = container_of(ref, struct ebb_pattern, ref);
+
+   kfree_rcu(p, rcu);
+}
+
+/** @brief Fetch the frame of the instance's pattern to show now, and advance the cursor
+ *  @param restart find the frame from the clock and the phase, after a change or a late wake up
+ *  @param skip a late wake up, the frames passed over count as skipped
+ *  @param frameNs how long the frame is to be shown
+ *  @return the frame's LED bits
+ */
+static u8 ebbgpio_pattern_step(bool restart, bool skip, u64 *frameNs){
+   struct ebb_pattern *p;
+   u32 pos, end = 0, i;
+   u8 leds = 0;
+
+   *frameNs = NSEC_PER_SEC;
+   rcu_read_lock();
+   p = rcu_dereference(ebb.pattern);
+   if (!p) goto out;
+   i = ebb.patternCursor;
+   if (restart || i >= p->numFrames){
+      div_u64_rem(div_u64(ktime_get_ns(), NSEC_PER_MSEC) + READ_ONCE(ebb.patternPhaseMs), p->periodMs, &pos);
+      for (i = 0; pos >= end + p->frames[i].duration_ms; i++) end += p->frames[i].duration_ms;
+      *frameNs = (u64)(end + p->frames[i].duration_ms - pos) * NSEC_PER_MSEC;
+      if (skip) ebb.blinkSkipped += (i + p->numFrames - ebb.patternCursor % p->numFrames) % p->numFrames;
+   }
+   else *frameNs = (u64)p->frames[i].duration_ms * NSEC_PER_MSEC;
+   leds = p->frames[i].leds;
+   ebb.patternCursor = (i + 1) % p->numFrames;
+out:
+   rcu_read_unlock();
+   return leds;
+}
+
+/** @brief The LED Flasher main kthread loop
+ *
+ *  @param arg A void pointer used in order to pass data to the thread
+ *  @return returns 0 if successful
+ */
+static int kThread_run(void *arg){
+   enum modes applied, pwmMode = OFF;
+   unsigned int period, pwmPeriod = 0, gen;
+   ktime_t next = 0;
+   u64 half, frameNs = 0;
+   unsigned long edge;
+   bool timed = false;					// next holds the deadline of the toggle being slept for
+   bool playing, skip, red, green;
+   u8 leds;
+   printk(KERN_INFO "EBB LED: Thread has started running \n");
+   while(!kthread_should_stop()){           		// Returns true when kthread_stop() is called
+      set_current_state(TASK_RUNNING);
+      if (kthread_should_park()){
+         kthread_parkme();				// Held while the KUnit tests swap the LED outputs
+         timed = false;
+         pwmPeriod = 0;					// The outputs may have changed, program them again
+      }
+      ebb.blinkWakeups++;
+      gen = atomic_read_acquire(&ebb.ledGen);		// Before the state it guards
+      applied = READ_ONCE(ebb.mode);
+      period = READ_ONCE(ebb.blinkPeriod);
+      if (applied != pwmMode || period != pwmPeriod){	// Only reprogram the hardware on a change
+         ebbgpio_pwm_apply(applied, period);
+         pwmMode = applied;
+         pwmPeriod = period;
+      }
+      playing = applied == FLASH && rcu_access_pointer(ebb.pattern);	// FLASH shows the selected pattern
+      if (playing){
+         // A frame sleep that expired goes through the same deadline accounting as the blink
+         skip = timed && ebbgpio_frame_deadline(&next, frameNs);
+         if (!timed) next = ktime_get();
+         leds = ebbgpio_pattern_step(!timed || skip, skip, &frameNs);
+         frameNs <<= ebb.blinkDegradeShift;		// A degraded pattern plays slower, in proportion
+         red = leds & BIT(EBBGPIO_LINE_RED);
+         green = leds & BIT(EBBGPIO_LINE_GREEN);
+      }
+      else {
+         if (applied==FLASH) ebb.ledOn = !ebb.ledOn;      		// Invert the LED state
+         else if (applied==ON) ebb.ledOn = true;
+         else ebb.ledOn = false;
+         red = green = ebb.ledOn;
+         if (READ_ONCE(arbWinner) == EBBGPIO_CLIENT_BOOT) green = !green;	// The boot pattern alternates
+      }
+      if (ebbgpio_led_sw(EBBGPIO_LINE_GREEN)) gpio_set_value(gpioLedGREEN, green);
+      if (ebbgpio_led_sw(EBBGPIO_LINE_RED)) gpio_set_value(gpioLedRED, red);	// Use the LED state to light/turn off the LED
+      if (READ_ONCE(ebb.edgeNs) && (edge = xchg(&ebb.edgeNs, 0)))	// A press is shown from here on
+         ebbgpio_latency_add(EBBGPIO_LAT_EDGE, ((unsigned long)ktime_get_ns() | 1) - edge);
+      set_current_state(TASK_INTERRUPTIBLE);
+      if (atomic_read(&ebb.ledGen) != gen || kthread_should_stop() || kthread_should_park()){
+         timed = false;
+         continue;					// Changed meanwhile, apply it now
+      }
+      if (playing && (ebbgpio_led_sw(EBBGPIO_LINE_RED) || ebbgpio_led_sw(EBBGPIO_LINE_GREEN))){
+         next = ktime_add_ns(next, frameNs);
+         timed = ebbgpio_sleep_until(&next, gen);
+      }
+      else if (applied == FLASH && (ebbgpio_led_sw(EBBGPIO_LINE_RED) || ebbgpio_led_sw(EBBGPIO_LINE_GREEN))){
+         // Absolute deadlines, so a late wake up is seen instead of silently stretching the blink
+         half = (u64)max(period/3, 1U) * NSEC_PER_MSEC;
+         if (!timed) next = ktime_add_ns(ktime_get(), half);
+         // The slack lets the toggle ride along with another timer already due in that window
+         timed = ebbgpio_sleep_until(&next, gen);
+         if (timed) ebbgpio_blink_deadline(&next, half);
+      }
+      else {
+         timed = false;
+         schedule();                      		// Steady or hardware blinked LEDs, sleep until the mode changes
+      }
+      }
+return 0;
+}
+
+
+/** @brief Set up an event queue
+ *  @param size number of events, must be a power of 2
+ *  @param wakeupEvents readers are woken once this many events are queued, 0 means every event
+ *  @return returns 0 if successful
+ */
+static int ebbgpio_queue_init(struct ebbgpio_queue *q, unsigned int size, unsigned int wakeupEvents){
+   spin_lock_init(&q->lock);
+   init_waitqueue_head(&q->wait);
+   q->wakeupEvents = wakeupEvents ? wakeupEvents : 1;
+   q->dropped = 0;
+   q->gapPending = 0;
+   return kfifo_alloc(&q->fifo, size, GFP_KERNEL);
+}
+
+/** @brief Report pending drops with a gap record if there is room, called with q->lock held
+ *  @param reserve slots that must stay free after the gap record
+ *  @return true when no drops are left unreported
+ */
+static bool ebbgpio_queue_put_gap(struct ebbgpio_queue *q, unsigned int reserve){
+   struct ebbgpio_event gap = {
+      .line = EBBGPIO_LINE_ANY,
+      .type = EBBGPIO_EVENT_GAP,
+   };
+
+   if (!q->gapPending) return true;
+   if (kfifo_avail(&q->fifo) < reserve + 1) return false;
+   gap.timestamp_ns = ktime_get_ns();
+   gap.value = min_t(unsigned long, q->gapPending, U32_MAX);
+   kfifo_put(&q->fifo, gap);
+   q->gapPending = 0;
+   return true;
+}
+
+/** @brief Add one event to a queue
+ *  Safe to call from the IRQ handler. When the queue is full the new event is dropped and counted,
+ *  so that a slow reader can never stall the interrupt path. The reader learns about the drops
+ *  from a gap record placed where the missing events would have been.
+ */
+static void ebbgpio_queue_push(struct ebbgpio_queue *q, const struct ebbgpio_event *ev){
+   unsigned long flags;
+   unsigned int len;
+
+   spin_lock_irqsave(&q->lock, flags);
+   if (!ebbgpio_queue_put_gap(q, 1) || !kfifo_put(&q->fifo, *ev)){
+      q->dropped++;
+      q->gapPending++;
+   }
+   len = kfifo_len(&q->fifo);
+   spin_unlock_irqrestore(&q->lock, flags);
+   if (len >= q->wakeupEvents) wake_up_interruptible_poll(&q->wait, EPOLLIN | EPOLLRDNORM);
+}
+
+/** @brief Take up to max queued events without sleeping
+ *  @return the number of events copied into buf
+ */
+static unsigned int ebbgpio_queue_fetch(struct ebbgpio_queue *q, struct ebbgpio_event *buf, unsigned int max){
+   unsigned long flags;
+   unsigned int n;
+
+   spin_lock_irqsave(&q->lock, flags);
+   n = kfifo_out(&q->fifo, buf, max);
+   ebbgpio_queue_put_gap(q, 0);             // Room again, tell the reader what it missed
+   spin_unlock_irqrestore(&q->lock, flags);
+   return n;
+}
+
+/** @brief Return the current counters so a restarted consumer can reconcile its state
+ *  Events with a sequence number up to the returned one are covered by the snapshot. With
+ *  EBBGPIO_RESYNC_FLUSH the queued events are discarded in the same step, so the consumer can
+ *  carry on from the snapshot instead of replaying the backlog.
+ *  @return returns 0 if successful
+ */
+static long ebbgpio_queue_resync(struct ebbgpio_queue *q, struct ebbgpio_resync __user *arg){
+   struct ebbgpio_resync r;
+   unsigned long flags;
+   unsigned int i;
+
+   if (copy_from_user(&r, arg, sizeof(r))) return -EFAULT;
+   if (r.flags & ~EBBGPIO_RESYNC_FLUSH) return -EINVAL;
+   memset(r.seqno, 0, sizeof(r.seqno));
+   spin_lock_irqsave(&q->lock, flags);
+   if (r.flags & EBBGPIO_RESYNC_FLUSH){
+      kfifo_reset(&q->fifo);
+      q->gapPending = 0;
+   }
+   for (i = 0; i < EBBGPIO_MAX_LINES; i++) r.seqno[i] = atomic_read(&lineSeq[i]);
+   r.dropped = q->dropped;
+   r.timestamp_ns = ktime_get_ns();
+   spin_unlock_irqrestore(&q->lock, flags);
+   r.presses = READ_ONCE(ebb.numberPresses);
+   return copy_to_user(arg, &r, sizeof(r)) ? -EFAULT : 0;
+}
+
+/// True once the queue holds enough events to satisfy its wakeup policy
+static bool ebbgpio_queue_ready(struct ebbgpio_queue *q){
+   return kfifo_len(&q->fifo) >= q->wakeupEvents;
+}
+
+/** @brief Queue an event for /dev/ebbgpio and every line request interested in it
+ *  The event is built and demultiplexed once here, in the producer, so readers only ever
+ *  wake for the lines and event types they asked for. Every event takes the next sequence
+ *  number of its line, whichever queues it ends up in.
+ *  @param line the enum ebbgpio_line the event belongs to
+ *  @param type the enum ebbgpio_event_type of the event
+ *  @param value type specific payload
+ */
+static void ebbgpio_queue_event(u32 line, u32 type, u32 value){
+   struct ebbgpio_event ev = {
+      .timestamp_ns = ktime_get_ns(),
+      .line = line,
+      .type = type,
+      .seqno = atomic_inc_return(&lineSeq[line]),
+      .value = value,
+   };
+   struct ebbgpio_line_req *lr;
+
+   ebbgpio_queue_push(&devQueue, &ev);
+   if (genl_has_listeners(&ebbgpio_genl_family, &init_net, 0)){
+      ebbgpio_queue_push(&nlQueue, &ev);    // The work item sends whatever piled up in one message
+      schedule_work(&nlWork);
+   }
+   rcu_read_lock();
+   list_for_each_entry_rcu(lr, &lineReqs, node){
+      if ((lr->lines & BIT_ULL(line)) && (lr->eventTypes & BIT(type)))
+         ebbgpio_queue_push(&lr->queue, &ev);
+   }
+   rcu_read_unlock();
+}
+
+/** @brief Read whole events from a queue
+ *  A blocking read waits until the queue's wakeup threshold is reached. A non-blocking read, or
+ *  io_uring asking with IOCB_NOWAIT, returns whatever is queued or -EAGAIN; together with poll
+ *  support this is what lets io_uring arm multishot reads on the device. Once events are
+ *  available the read keeps draining the queue until the destination is full, so large reads
+ *  and splices move a whole backlog per call.
+ */
+static ssize_t ebbgpio_queue_read(struct ebbgpio_queue *q, struct kiocb *iocb, struct iov_iter *to){
+   struct ebbgpio_event events[16];
+   bool nonblock = (iocb->ki_flags & IOCB_NOWAIT) || (iocb->ki_filp->f_flags & O_NONBLOCK);
+   size_t max, done = 0;
+   unsigned int n;
+   int ret;
+
+   if (iov_iter_count(to) < sizeof(struct ebbgpio_event)) return -EINVAL;
+   for (;;){
+      if (!nonblock){
+         ret = wait_event_interruptible(q->wait, ebbgpio_queue_ready(q));
+         if (ret) return ret;
+      }
+      n = ebbgpio_queue_fetch(q, events, 1);
+      if (n) break;
+      if (nonblock) return -EAGAIN;
+   }
+   do {
+      if (copy_to_iter(events, n * sizeof(*events), to) != n * sizeof(*events)) return done ? done : -EFAULT;
+      done += n * sizeof(*events);
+      max = min(iov_iter_count(to) / sizeof(struct ebbgpio_event), ARRAY_SIZE(events));
+   } while (max && (n = ebbgpio_queue_fetch(q, events, max)));
+   return done;
+}
+
+static __poll_t ebbgpio_queue_poll(struct ebbgpio_queue *q, struct file *file, poll_table *wait){
+   poll_wait(file, &q->wait, wait);
+   return ebbgpio_queue_ready(q) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static ssize_t ebbgpio_line_read_iter(struct kiocb *iocb, struct iov_iter *to){
+   struct ebbgpio_line_req *lr = iocb->ki_filp->private_data;
+   return ebbgpio_queue_read(&lr->queue, iocb, to);
+}
+
+static __poll_t ebbgpio_line_poll(struct file *file, poll_table *wait){
+   struct ebbgpio_line_req *lr = file->private_data;
+   return ebbgpio_queue_poll(&lr->queue, file, wait);
+}
+
+/** @brief Release a line request when its last file reference goes away
+ *  The producer may still be walking the list, so wait for an RCU grace period before freeing.
+ */
+static int ebbgpio_line_release(struct inode *inode, struct file *file){
+   struct ebbgpio_line_req *lr = file->private_data;
+
+   mutex_lock(&lineReqLock);
+   list_del_rcu(&lr->node);
+   mutex_unlock(&lineReqLock);
+   synchronize_rcu();
+   kfifo_free(&lr->queue.fifo);
+   kfree(lr);
+   return 0;
+}
+
+static long ebbgpio_line_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
+   struct ebbgpio_line_req *lr = file->private_data;
+
+   if (cmd != EBBGPIO_IOC_RESYNC) return -ENOTTY;
+   return ebbgpio_queue_resync(&lr->queue, (void __user *)arg);
+}
+
+static const struct file_operations ebbgpio_line_fops = {
+   .owner          = THIS_MODULE,
+   .unlocked_ioctl = ebbgpio_line_ioctl,
+   .compat_ioctl   = compat_ptr_ioctl,
+   .read_iter      = ebbgpio_line_read_iter,
+   .splice_read    = copy_splice_read,
+   .poll           = ebbgpio_line_poll,
+   .release        = ebbgpio_line_release,
+};
+
+/** @brief Create a line request and return its new file descriptor
+ *  Modeled after the GPIO v2 line requests: the fd only sees events for the requested lines and
+ *  event types, with its own queue size and wakeup threshold.
+ *  @return returns 0 if successful, the fd is written back into the request
+ */
+static long ebbgpio_line_request(struct ebbgpio_line_request __user *arg){
+   struct ebbgpio_line_request req;
+   struct ebbgpio_line_req *lr;
+   struct file *file;
+   unsigned int size;
+   int fd, ret;
+
+   if (copy_from_user(&req, arg, sizeof(req))) return -EFAULT;
+   if (!req.lines || (req.lines & ~GENMASK_ULL(EBBGPIO_NUM_LINES - 1, 0))) return -EINVAL;
+   size = req.queue_size ? req.queue_size : EVENT_FIFO_SIZE;
+   if (size > EVENT_FIFO_MAX || req.wakeup_events > size) return -EINVAL;
+
+   lr = kzalloc(sizeof(*lr), GFP_KERNEL);
+   if (!lr) return -ENOMEM;
+   lr->lines = req.lines;
+   lr->eventTypes = req.event_types ? req.event_types : ~0U;
+   ret = ebbgpio_queue_init(&lr->queue, roundup_pow_of_two(size), req.wakeup_events);
+   if (ret) goto err_free;
+
+   fd = get_unused_fd_flags(O_RDONLY | O_CLOEXEC);
+   if (fd < 0){
+      ret = fd;
+      goto err_fifo;
+   }
+   file = anon_inode_getfile("ebbgpio-line", &ebbgpio_line_fops, lr, O_RDONLY | O_CLOEXEC);
+   if (IS_ERR(file)){
+      ret = PTR_ERR(file);
+      goto err_fd;
+   }
+   file->f_mode |= FMODE_NOWAIT;
+
+   mutex_lock(&lineReqLock);
+   list_add_tail_rcu(&lr->node, &lineReqs);
+   mutex_unlock(&lineReqLock);
+
+   req.fd = fd;
+   if (copy_to_user(arg, &req, sizeof(req))){
+      fput(file);                            // Release unlinks and frees the request
+      put_unused_fd(fd);
+      return -EFAULT;
+   }
+   fd_install(fd, file);
+   return 0;
+
+err_fd:
+   put_unused_fd(fd);
+err_fifo:
+   kfifo_free(&lr->queue.fifo);
+err_free:
+   kfree(lr);
+   return ret;
+}
+
+/** @brief Append count samples to the capture ring
+ *  Consecutive samples with the same levels extend the newest record instead of using a new one,
+ *  so idle lines cost almost nothing. head is published with release semantics for mmap readers,
+ *  after EBBGPIO_CAPTURE_WRAPPED once the ring has been filled.
+ */
+static void ebbgpio_capture_store(struct ebbgpio_capture_header *hdr, u32 levels, u64 count){
+   u32 *recs = (u32 *)(hdr + 1);
+   u32 mask = hdr->num_records - 1;
+   u32 head = hdr->head;
+   u32 *last = head || hdr->flags ? &recs[(head - 1) & mask] : NULL;
+   u32 n;
+
+   while (count){
+      if (last && EBBGPIO_CAPTURE_LEVELS(*last) == levels && EBBGPIO_CAPTURE_RUN(*last) < EBBGPIO_CAPTURE_RUN_MAX){
+         n = min_t(u64, count, EBBGPIO_CAPTURE_RUN_MAX - EBBGPIO_CAPTURE_RUN(*last));
+         WRITE_ONCE(*last, *last + (n << 8));
+         count -= n;
+      } else {
+         last = &recs[head & mask];
+         WRITE_ONCE(*last, levels | (1U << 8));
+         count--;
+         if (++head == hdr->num_records) WRITE_ONCE(hdr->flags, EBBGPIO_CAPTURE_WRAPPED);
+         smp_store_release(&hdr->head, head);
+      }
+   }
+}
+
+/** @brief The capture kthread loop
+ *  Reads all captured lines with one bulk gpiod call per sample on an absolute hrtimer schedule.
+ *  The _cansleep accessor keeps it usable with sleeping GPIO chips such as gpio-sim. Sample slots
+ *  the thread wakes too late for are held at the last levels and counted as overruns, so the time
+ *  axis stays exact and the overrun counter shows when the rate is not sustainable.
+ */
+static int ebbgpio_capture_run(void *arg){
+   struct ebbgpio_capture_header *hdr = captureBuf;
+   u64 periodNs = NSEC_PER_SEC / hdr->rate_hz;
+   DECLARE_BITMAP(values, EBBGPIO_CAPTURE_MAX_LINES);
+   ktime_t next = ktime_get(), now;
+   u32 levels = 0;
+   u64 missed;
+
+   WRITE_ONCE(hdr->start_ns, ktime_to_ns(next));
+   while (!kthread_should_stop()){
+      if (!gpiod_get_raw_array_value_cansleep(captureNumLines, captureDescs, NULL, values))
+         levels = values[0] & 0xff;
+      ebbgpio_capture_store(hdr, levels, 1);
+      WRITE_ONCE(hdr->samples, hdr->samples + 1);
+      next = ktime_add_ns(next, periodNs);
+      now = ktime_get();
+      if (ktime_after(now, next)){
+         missed = div64_u64(ktime_to_ns(ktime_sub(now, next)), periodNs) + 1;
+         ebbgpio_capture_store(hdr, levels, missed);
+         WRITE_ONCE(hdr->samples, hdr->samples + missed);
+         WRITE_ONCE(hdr->overruns, hdr->overruns + missed);
+         next = ktime_add_ns(next, missed * periodNs);
+      }
+      set_current_state(TASK_INTERRUPTIBLE);
+      if (!kthread_should_stop()) schedule_hrtimeout_range(&next, 0, HRTIMER_MODE_ABS);
+      __set_current_state(TASK_RUNNING);
+   }
+   return 0;
+}
+
+/// Stop a running capture, the caller holds captureLock
+static void ebbgpio_capture_stop(void){
+   if (captureTask){
+      kthread_stop(captureTask);
+      captureTask = NULL;
+   }
+}
+
+/** @brief Start, restart or stop logic-analyzer capture
+ *  Starting resets the ring, so a reader that mapped the buffer should note head and samples
+ *  afresh after each start.
+ *  @return returns 0 if successful
+ */
+static long ebbgpio_capture(struct ebbgpio_capture __user *arg){
+   struct ebbgpio_capture_header *hdr = captureBuf;
+   struct ebbgpio_capture c;
+   unsigned int line, n = 0;
+   int ret = 0;
+
+   if (copy_from_user(&c, arg, sizeof(c))) return -EFAULT;
+   if (c.reserved) return -EINVAL;
+   if (c.rate_hz && (!c.lines || (c.lines & ~GENMASK_ULL(EBBGPIO_NUM_LINES - 1, 0)) ||
+                     hweight64(c.lines) > EBBGPIO_CAPTURE_MAX_LINES || c.rate_hz > captureMaxRate))
+      return -EINVAL;
+
+   mutex_lock(&captureLock);
+   ebbgpio_capture_stop();
+   if (c.rate_hz == 0) goto out;
+   for (line = 0; line < EBBGPIO_NUM_LINES; line++){
+      if (c.lines & BIT_ULL(line)) captureDescs[n++] = gpio_to_desc(*lineGpio[line]);
+   }
+   captureNumLines = n;
+   hdr->lines = c.lines;
+   hdr->rate_hz = c.rate_hz;
+   hdr->samples = 0;
+   hdr->overruns = 0;
+   hdr->start_ns = 0;
+   hdr->flags = 0;
+   smp_store_release(&hdr->head, 0);
+   captureTask = kthread_run(ebbgpio_capture_run, NULL, "LED_capture");
+   if (IS_ERR(captureTask)){
+      ret = PTR_ERR(captureTask);
+      captureTask = NULL;
+   }
+out:
+   mutex_unlock(&captureLock);
+   return ret;
+}
+
+/** @brief Allocate the capture buffer and fill in the fixed part of its header
+ *  @return returns 0 if successful
+ */
+static int ebbgpio_capture_init(void){
+   struct ebbgpio_capture_header *hdr;
+   size_t size = PAGE_ALIGN((size_t)captureBufKiB * 1024);
+
+   if (size < PAGE_SIZE) return -EINVAL;
+   captureBuf = vmalloc_user(size);         // Zeroed, and suitable for remap_vmalloc_range()
+   if (!captureBuf) return -ENOMEM;
+   hdr = captureBuf;
+   hdr->magic = EBBGPIO_CAPTURE_MAGIC;
+   hdr->version = EBBGPIO_CAPTURE_VERSION;
+   hdr->num_records = rounddown_pow_of_two((size - sizeof(*hdr)) / sizeof(u32));
+   return 0;
+}
+
+/** @brief Snapshot of the current LED configuration
+ *  This is the configured request, not necessarily what a higher priority request shows now.
+ */
+static void ebbgpio_get_config(struct ebbgpio_config *cfg){
+   struct ebbgpio_arb_slot *s = &arbSlots[EBBGPIO_CLIENT_CONFIG];
+   unsigned long flags;
+
+   memset(cfg, 0, sizeof(*cfg));
+   spin_lock_irqsave(&arbLock, flags);
+   cfg->mode = s->mode;
+   cfg->blink_period_ms = s->period;
+   spin_unlock_irqrestore(&arbLock, flags);
+   cfg->slack_us[EBBGPIO_LINE_RED] = READ_ONCE(ebb.blinkSlackUs[EBBGPIO_LINE_RED]);
+   cfg->slack_us[EBBGPIO_LINE_GREEN] = READ_ONCE(ebb.blinkSlackUs[EBBGPIO_LINE_GREEN]);
+}
+
+/** @brief Bit-bang one frame on the strip GPIO, with interrupts disabled for one pixel at a time
+ *  Every WS2812 bit is a high pulse of T0H or T1H inside a fixed bit period, timed against the
+ *  fast monotonic clock rather than by counting gpio calls, so the time a GPIO write takes on a
+ *  given SoC only eats into the margin instead of shifting every edge. Interrupts are taken
+ *  between pixels, where the line is low and the strip only latches after the reset time, so a
+ *  long frame no longer holds them off for milliseconds.
+ */
+static void ebbgpio_strip_bitbang(const u8 *grb, unsigned int len){
+   unsigned long flags;
+   unsigned int i;
+   u64 start;
+   u8 byte, bit;
+
+   for (i = 0; i < len; i++){
+      if (i % 3 == 0) local_irq_save(flags);
+      byte = grb[i];
+      for (bit = 0x80; bit; bit >>= 1){
+         start = ktime_get_mono_fast_ns();
+         gpiod_set_raw_value(stripDesc, 1);
+         while (ktime_get_mono_fast_ns() - start < ((byte & bit) ? WS2812_T1H_NS : WS2812_T0H_NS)) cpu_relax();
+         gpiod_set_raw_value(stripDesc, 0);
+         while (ktime_get_mono_fast_ns() - start < WS2812_BIT_NS) cpu_relax();
+      }
+      if (i % 3 == 2 || i == len - 1) local_irq_restore(flags);
+   }
+}
+
+/** @brief Encode one frame for SPI MOSI into stripSpiBuf
+ *  Each WS2812 bit becomes three SPI bits at 2.4 MHz, 100 for a zero and 110 for a one, so the
+ *  controller's shift register does the timing. The zero bytes at the end are the reset.
+ *  @return the number of bytes to send
+ */
+static unsigned int ebbgpio_strip_spi_encode(const u8 *grb, unsigned int len){
+   u8 *out = stripSpiBuf;
+   unsigned int i;
+
+   for (i = 0; i < len; i++, out += 3) memcpy(out, ws2812SpiCode[grb[i]], 3);
+   memset(out, 0, WS2812_SPI_RESET_BYTES);
+   return len * 3 + WS2812_SPI_RESET_BYTES;
+}
+
+/** @brief Send the newest frame whenever it changed
+ *  The back buffer is copied to the front buffer under stripLock, so writers are only ever
+ *  blocked for a memcpy and never for the transmission itself. Runs on its own workqueue, since
+ *  a bit-banged frame keeps the CPU busy for up to about 30 ms.
+ *  The CPU time is what the frame costs the processor: the encoding on SPI, where the transfer
+ *  itself is a sleep, or the whole bit-banged frame, without the reset time slept after it.
+ */
+static void ebbgpio_strip_work(struct work_struct *work){
+   unsigned int len = min(READ_ONCE(stripLength) ? : stripPixels, stripPixels) * 3, n;
+   u64 start, cpu;
+
+   mutex_lock(&stripTxLock);
+   for (;;){
+      mutex_lock(&stripLock);
+      if (!stripDirty){
+         mutex_unlock(&stripLock);
+         break;
+      }
+      memcpy(stripFront, stripBack, len);
+      stripDirty = false;
+      mutex_unlock(&stripLock);
+
+      start = ktime_get_ns();
+      if (stripSpi){
+         n = ebbgpio_strip_spi_encode(stripFront, len);
+         cpu = ktime_get_ns() - start;
+         spi_write(stripSpi, stripSpiBuf, n);
+      }
+      else if (stripDesc){
+         ebbgpio_strip_bitbang(stripFront, len);
+         cpu = ktime_get_ns() - start;
+         usleep_range(WS2812_RESET_US, 2 * WS2812_RESET_US);	// Low long enough to latch the frame
+      }
+      else break;
+      WRITE_ONCE(stripFrames, stripFrames + 1);
+      WRITE_ONCE(stripCpuNs, cpu);
+      WRITE_ONCE(stripCpuNsTotal, stripCpuNsTotal + cpu);
+      WRITE_ONCE(stripFrameNs, ktime_get_ns() - start);
+      WRITE_ONCE(stripFrameNsTotal, stripFrameNsTotal + stripFrameNs);
+   }
+   mutex_unlock(&stripTxLock);
+}
+
+/** @brief Update pixels of the strip from user space
+ *  Pixels are given as R, G, B bytes and stored in the strip's G, R, B order. Only a changed
+ *  frame is sent, and updates arriving during a transmission are merged into the next frame.
+ *  @return returns 0 if successful
+ */
+static long ebbgpio_strip_frame(struct ebbgpio_strip_frame __user *arg){
+   struct ebbgpio_strip_frame f;
+   u8 rgb[3 * 32];
+   unsigned int i, n, done = 0;
+   bool changed = false;
+   long ret = 0;
+   u8 *px;
+
+   if (copy_from_user(&f, arg, sizeof(f))) return -EFAULT;
+   if (!stripBack) return -ENODEV;
+   if (f.offset > stripPixels || f.count > stripPixels - f.offset) return -EINVAL;
+   mutex_lock(&stripLock);
+   while (done < f.count){
+      n = min_t(u32, f.count - done, ARRAY_SIZE(rgb) / 3);
+      if (copy_from_user(rgb, u64_to_user_ptr(f.rgb) + done * 3, n * 3)){
+         ret = -EFAULT;                     // The pixels already stored are still sent
+         break;
+      }
+      for (i = 0; i < n; i++){
+         px = &stripBack[(f.offset + done + i) * 3];
+         changed |= px[0] != rgb[3 * i + 1] || px[1] != rgb[3 * i] || px[2] != rgb[3 * i + 2];
+         px[0] = rgb[3 * i + 1];
+         px[1] = rgb[3 * i];
+         px[2] = rgb[3 * i + 2];
+      }
+      done += n;
+   }
+   if (changed) stripDirty = true;
+   mutex_unlock(&stripLock);
+   if (changed) queue_work(stripWq, &stripWork);
+   return ret;
+}
+
+static int ebbgpio_strip_spi_probe(struct spi_device *spi){
+   int ret;
+
+   spi->mode = SPI_MODE_0;
+   spi->bits_per_word = 8;
+   spi->max_speed_hz = WS2812_SPI_HZ;
+   ret = spi_setup(spi);
+   if (ret) return ret;
+   mutex_lock(&stripTxLock);
+   stripSpi = spi;
+   mutex_unlock(&stripTxLock);
+   mutex_lock(&stripLock);
+   stripDirty = true;                       // Show the current frame on the new output
+   mutex_unlock(&stripLock);
+   queue_work(stripWq, &stripWork);
+   return 0;
+}
+
+static void ebbgpio_strip_spi_remove(struct spi_device *spi){
+   mutex_lock(&stripTxLock);
+   stripSpi = NULL;
+   mutex_unlock(&stripTxLock);
+}
+
+static const struct of_device_id ebbgpio_strip_of_match[] = {
+   { .compatible = "ebb,ws2812-spi" },
+   { }
+};
+MODULE_DEVICE_TABLE(of, ebbgpio_strip_of_match);
+
+static const struct spi_device_id ebbgpio_strip_spi_ids[] = {
+   { "ws2812-spi" },
+   { }
+};
+MODULE_DEVICE_TABLE(spi, ebbgpio_strip_spi_ids);
+
+static struct spi_driver ebbgpio_strip_spi_driver = {
+   .driver = {
+      .name           = "ebbgpio-ws2812",
+      .of_match_table = ebbgpio_strip_of_match,
+   },
+   .probe    = ebbgpio_strip_spi_probe,
+   .remove   = ebbgpio_strip_spi_remove,
+   .id_table = ebbgpio_strip_spi_ids,
+};
+
+/** @brief Set up the WS2812 engine when a strip is configured
+ *  A strip is driven through an SPI device bound to this driver when there is one, and by
+ *  bit-banging gpioStrip otherwise.
+ *  @return returns 0 if successful
+ */
+static int ebbgpio_strip_init(void){
+   unsigned int b, bit, code;
+   int ret;
+
+   if (stripPixels == 0) return 0;
+   if (stripPixels > WS2812_MAX_PIXELS) return -EINVAL;
+   for (b = 0; b < 256; b++){               // Three SPI bits per data bit, MSB first
+      for (code = 0, bit = 0x80; bit; bit >>= 1) code = (code << 3) | ((b & bit) ? 6 : 4);
+      ws2812SpiCode[b][0] = code >> 16;
+      ws2812SpiCode[b][1] = code >> 8;
+      ws2812SpiCode[b][2] = code;
+   }
+   stripFront = kzalloc(stripPixels * 3, GFP_KERNEL);
+   stripBack = kzalloc(stripPixels * 3, GFP_KERNEL);
+   stripSpiBuf = kzalloc(stripPixels * 9 + WS2812_SPI_RESET_BYTES, GFP_KERNEL);
+   stripWq = alloc_ordered_workqueue("ebbgpio_strip", WQ_HIGHPRI);	// Frames go out one at a time, promptly
+   if (!stripFront || !stripBack || !stripSpiBuf || !stripWq){
+      ret = -ENOMEM;
+      goto err_free;
+   }
+   if (gpioStrip >= 0){
+      ret = gpio_request(gpioStrip, "ws2812");
+      if (ret) goto err_free;
+      stripDesc = gpio_to_desc(gpioStrip);
+      if (gpiod_cansleep(stripDesc)){      // Bit-banging cannot wait for an I2C or SPI expander
+         printk(KERN_ERR "GPIO_TEST: strip GPIO %d is behind a sleeping controller\n", gpioStrip);
+         ret = -EINVAL;
+         goto err_gpio;
+      }
+      gpio_direction_output(gpioStrip, 0);
+   }
+   ret = spi_register_driver(&ebbgpio_strip_spi_driver);
+   if (ret) goto err_gpio;
+   return 0;
+
+err_gpio:
+   if (stripDesc) gpio_free(gpioStrip);
+   stripDesc = NULL;
+err_free:
+   if (stripWq) destroy_workqueue(stripWq);
+   kfree(stripSpiBuf);
+   kfree(stripBack);
+   kfree(stripFront);
+   stripBack = NULL;
+   return ret;
+}
+
+static void ebbgpio_strip_exit(void){
+   if (!stripBack) return;
+   spi_unregister_driver(&ebbgpio_strip_spi_driver);
+   cancel_work_sync(&stripWork);
+   destroy_workqueue(stripWq);
+   if (stripDesc) gpio_free(gpioStrip);
+   kfree(stripSpiBuf);
+   kfree(stripBack);
+   kfree(stripFront);
+}
+
+/** @brief Take up to VLC_MAX_PAYLOAD queued bytes and frame them for transmission
+ *  Frame: two 0x55 preamble bytes, the 0xD5 start delimiter, a length byte, the payload and a
+ *  CRC-16/CCITT over length and payload, low byte first.
+ *  @return false when there is nothing to send
+ */
+static bool ebbgpio_vlc_tx_load(void){
+   unsigned int len;
+   u16 crc;
+
+   len = kfifo_out(&vlcTxFifo, &vlcTxFrame[4], VLC_MAX_PAYLOAD);
+   if (!len) return false;
+   vlcTxFrame[0] = 0x55;
+   vlcTxFrame[1] = 0x55;
+   vlcTxFrame[2] = VLC_SFD;
+   vlcTxFrame[3] = len;
+   crc = crc_ccitt(0xffff, &vlcTxFrame[3], len + 1);
+   vlcTxFrame[4 + len] = crc & 0xff;
+   vlcTxFrame[5 + len] = crc >> 8;
+   vlcTxLen = len + 6;
+   vlcTxHalf = 0;
+   vlcTxFrames++;
+   wake_up_interruptible(&vlcTxWait);
+   return true;
+}
+
+/** @brief Transmit hrtimer, runs once per half bit
+ *  Manchester code as in IEEE 802.3: a 0 is high then low, a 1 is low then high. Between frames
+ *  the LED stays dark for VLC_GAP_HALVES half bits, which the receiver uses to resynchronise.
+ */
+static enum hrtimer_restart ebbgpio_vlc_tx_tick(struct hrtimer *t){
+   unsigned int h = vlcTxHalf, bit;
+   int level = 0;
+
+   if (h >= vlcTxLen * 16 + VLC_GAP_HALVES){
+      if (!ebbgpio_vlc_tx_load()){
+         clear_bit(0, &vlcTxBusy);
+         smp_mb__after_atomic();            // Pairs with the writer, which fills then tests
+         if (kfifo_is_empty(&vlcTxFifo) || test_and_set_bit(0, &vlcTxBusy)) return HRTIMER_NORESTART;
+         ebbgpio_vlc_tx_load();
+      }
+      h = 0;
+   }
+   if (h < vlcTxLen * 16){
+      bit = (vlcTxFrame[h / 16] >> (7 - (h / 2) % 8)) & 1;
+      level = (h & 1) ? bit : !bit;
+   }
+   gpio_set_value(*lineGpio[vlcTxLed], level);
+   vlcTxHalf = h + 1;
+   hrtimer_forward_now(t, ns_to_ktime((u64)vlcBitUs * NSEC_PER_USEC / 2));
+   return HRTIMER_RESTART;
+}
+
+/// Forget a partly received frame and look for the next preamble
+static void ebbgpio_vlc_rx_reset(void){
+   vlcRxState = VLC_RX_HUNT;
+   vlcRxPos = 0;
+   vlcRxBits = 0;
+   vlcRxShift = 0;
+}
+
+/// Feed one decoded bit into the receive framer, called from the RX interrupt
+static void ebbgpio_vlc_rx_bit(unsigned int bit){
+   u16 crc;
+
+   vlcRxShift = (vlcRxShift << 1) | bit;
+   if (vlcRxState == VLC_RX_HUNT){           // Slide over the preamble until the start delimiter
+      if ((vlcRxShift & 0xff) == VLC_SFD){
+         vlcRxState = VLC_RX_LENGTH;
+         vlcRxBits = 0;
+      }
+      return;
+   }
+   if (++vlcRxBits < 8) return;
+   vlcRxBits = 0;
+   vlcRxFrame[vlcRxPos++] = vlcRxShift & 0xff;
+   if (vlcRxState == VLC_RX_LENGTH){
+      if (vlcRxFrame[0] == 0 || vlcRxFrame[0] > VLC_MAX_PAYLOAD){
+         vlcRxErrors++;
+         ebbgpio_vlc_rx_reset();
+      }
+      else vlcRxState = VLC_RX_DATA;
+      return;
+   }
+   if (vlcRxPos < vlcRxFrame[0] + 3) return;   // Length, payload and two CRC bytes
+   crc = crc_ccitt(0xffff, vlcRxFrame, vlcRxFrame[0] + 1);
+   if (crc == (vlcRxFrame[vlcRxPos - 2] | (vlcRxFrame[vlcRxPos - 1] << 8))){
+      vlcRxFrames++;
+      if (kfifo_in(&vlcRxFifo, &vlcRxFrame[1], vlcRxFrame[0]) < vlcRxFrame[0]) vlcRxDropped++;
+      wake_up_interruptible(&vlcRxWait);
+   }
+   else vlcRxErrors++;
+   ebbgpio_vlc_rx_reset();
+}
+
+/** @brief Receive interrupt, both edges of gpioVlcRx
+ *  Decodes Manchester from the edge timestamps alone: an edge one half bit after a mid-bit edge
+ *  is a bit boundary, an edge one half bit after a boundary or a full bit after any edge is the
+ *  middle of the next bit, and its direction is the bit value. A full bit apart, both edges are
+ *  mid-bit, which also syncs a receiver that took the first edge for a boundary. Any other spacing, such as
+ *  the gap between frames, restarts the search for a preamble.
+ */
+static irqreturn_t ebbgpio_vlc_rx_irq(int irq, void *dev_id){
+   u64 now = ktime_get_ns();
+   u64 half = (u64)vlcBitUs * NSEC_PER_USEC / 2;
+   u64 dt = now - vlcRxLastNs;
+
+   vlcRxLastNs = now;
+   vlcRxLevel = !vlcRxLevel;
+   if (dt > half / 2 && dt < half + half / 2){        // One half bit
+      if (vlcRxMidBit) vlcRxMidBit = false;
+      else {
+         vlcRxMidBit = true;
+         ebbgpio_vlc_rx_bit(vlcRxLevel);
+      }
+   }
+   else if (dt >= half + half / 2 && dt < 2 * half + half / 2){	// One full bit, only ever between mid-bit edges
+      vlcRxMidBit = true;
+      ebbgpio_vlc_rx_bit(vlcRxLevel);
+   }
+   else {                                   // Idle gap or a glitch: this edge leaves the dark line
+      if (vlcRxState != VLC_RX_HUNT) vlcRxErrors++;
+      ebbgpio_vlc_rx_reset();
+      vlcRxLevel = 1;
+      vlcRxMidBit = false;
+   }
+   return IRQ_HANDLED;
+}
+
+static ssize_t ebbvlc_read(struct file *file, char __user *buf, size_t len, loff_t *off){
+   unsigned int copied;
+   int ret;
+
+   if (gpioVlcRx < 0) return -ENODEV;
+   if (mutex_lock_interruptible(&vlcReadLock)) return -ERESTARTSYS;
+   while (kfifo_is_empty(&vlcRxFifo)){
+      mutex_unlock(&vlcReadLock);
+      if (file->f_flags & O_NONBLOCK) return -EAGAIN;
+      if (wait_event_interruptible(vlcRxWait, !kfifo_is_empty(&vlcRxFifo))) return -ERESTARTSYS;
+      if (mutex_lock_interruptible(&vlcReadLock)) return -ERESTARTSYS;
+   }
+   ret = kfifo_to_user(&vlcRxFifo, buf, len, &copied);
+   mutex_unlock(&vlcReadLock);
+   return ret ? ret : copied;
+}
+
+static ssize_t ebbvlc_write(struct file *file, const char __user *buf, size_t len, loff_t *off){
+   unsigned int copied;
+   int ret;
+
+   if (vlcTxLed < 0) return -ENODEV;
+   if (mutex_lock_interruptible(&vlcWriteLock)) return -ERESTARTSYS;
+   while (kfifo_is_full(&vlcTxFifo)){
+      mutex_unlock(&vlcWriteLock);
+      if (file->f_flags & O_NONBLOCK) return -EAGAIN;
+      if (wait_event_interruptible(vlcTxWait, !kfifo_is_full(&vlcTxFifo))) return -ERESTARTSYS;
+      if (mutex_lock_interruptible(&vlcWriteLock)) return -ERESTARTSYS;
+   }
+   ret = kfifo_from_user(&vlcTxFifo, buf, len, &copied);
+   mutex_unlock(&vlcWriteLock);
+   if (copied && !test_and_set_bit(0, &vlcTxBusy)){
+      vlcTxHalf = vlcTxLen * 16 + VLC_GAP_HALVES;  // Start with loading a frame
+      hrtimer_start(&vlcTxTimer, 0, HRTIMER_MODE_REL);
+   }
+   return ret ? ret : copied;
+}
+
+static __poll_t ebbvlc_poll(struct file *file, poll_table *wait){
+   __poll_t mask = 0;
+
+   poll_wait(file, &vlcRxWait, wait);
+   poll_wait(file, &vlcTxWait, wait);
+   if (!kfifo_is_empty(&vlcRxFifo)) mask |= EPOLLIN | EPOLLRDNORM;
+   if (!kfifo_is_full(&vlcTxFifo)) mask |= EPOLLOUT | EPOLLWRNORM;
+   return mask;
+}
+
+static const struct file_operations ebbvlc_fops = {
+   .owner = THIS_MODULE,
+   .open  = stream_open,
+   .read  = ebbvlc_read,
+   .write = ebbvlc_write,
+   .poll  = ebbvlc_poll,
+};
+
+static struct miscdevice ebbvlc_misc = {
+   .minor = MISC_DYNAMIC_MINOR,
+   .name  = "ebbvlc",                       // Appears as /dev/ebbvlc
+   .fops  = &ebbvlc_fops,
+   .mode  = 0660,
+};
+
+/** @brief Set up the optical link when a transmit LED or a receive line is configured
  *  @return returns 0 if successful
  */
-static int kThread_run(void *arg){
-   printk(KERN_INFO "EBB LED: Thread has started running \n");
-   while(!kthread_should_stop()){           		// Returns true when kthread_stop() is called
-      set_current_state(TASK_RUNNING);
-      if (mode==FLASH) ledOn = !ledOn;      		// Invert the LED state
-      else if (mode==ON) ledOn = true;
-      else ledOn = false;
-      gpio_set_value(gpioLedGREEN,ledOn);
-      gpio_set_value(gpioLedRED, ledOn);       		// Use the LED state to light/turn off the LED
+static int ebbgpio_vlc_init(void){
+   int ret;
+
+   if (vlcTxLed < 0 && gpioVlcRx < 0) return 0;
+   if (vlcTxLed > EBBGPIO_LINE_GREEN || vlcBitUs < VLC_MIN_BIT_US) return -EINVAL;
+   hrtimer_setup(&vlcTxTimer, ebbgpio_vlc_tx_tick, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+   // The line idles dark between frames, receivers take the first edge after a gap as rising
+   if (vlcTxLed >= 0) gpio_set_value(*lineGpio[vlcTxLed], 0);
+   if (gpioVlcRx >= 0){
+      ret = gpio_request(gpioVlcRx, "vlc_rx");
+      if (ret) return ret;
+      gpio_direction_input(gpioVlcRx);
+      ret = request_irq(gpio_to_irq(gpioVlcRx), ebbgpio_vlc_rx_irq, IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING,
+                        "ebb_vlc_rx", NULL);
+      if (ret) goto err_gpio;
+   }
+   ret = misc_register(&ebbvlc_misc);
+   if (ret) goto err_irq;
+   vlcEnabled = true;
+   return 0;
+
+err_irq:
+   if (gpioVlcRx >= 0) free_irq(gpio_to_irq(gpioVlcRx), NULL);
+err_gpio:
+   if (gpioVlcRx >= 0) gpio_free(gpioVlcRx);
+   return ret;
+}
+
+static void ebbgpio_vlc_exit(void){
+   if (!vlcEnabled) return;
+   misc_deregister(&ebbvlc_misc);
+   hrtimer_cancel(&vlcTxTimer);
+   if (gpioVlcRx >= 0){
+      free_irq(gpio_to_irq(gpioVlcRx), NULL);
+      gpio_free(gpioVlcRx);
+   }
+   vlcEnabled = false;
+}
+
+/** @brief What a button press does, shared by the edge IRQ and touch pad 0
+ *  Each press switches the button's ON request on or off, below it the configured mode shows again.
+ */
+static void ebbgpio_button_action(void){
+   WRITE_ONCE(ebb.edgeNs, (unsigned long)ktime_get_ns() | 1);	// Truncated on 32 bit, the delta still fits
+   ebbgpio_toggle_request(EBBGPIO_CLIENT_BUTTON, EBBGPIO_PRIO_BUTTON, EBBGPIO_MODE_ON);
+   ebb.numberPresses++;                     // Global counter, will be outputted when the module is unloaded
+   ebbgpio_idle_input();                    // Back from the idle pattern, if it was shown
+   ebbgpio_queue_event(EBBGPIO_LINE_BUTTON, EBBGPIO_EVENT_PRESS, 0);   // Hand the press to /dev/ebbgpio readers
+}
+
+/** @brief Track the baseline of one pad and report touches and releases
+ *  Everything is in fixed point with TOUCH_FRAC fraction bits. The baseline follows slow drift
+ *  from temperature and humidity only while the pad is untouched, and the release threshold is
+ *  half the touch threshold so a pad on the edge does not chatter.
+ */
+static void ebbgpio_touch_update(unsigned int i, u64 now){
+   struct ebbgpio_touch_pad *p = &touchPad[i];
+   u64 raw = (u64)p->raw << TOUCH_FRAC, thresh;	// 64 bits, so the sum with the threshold cannot wrap
+   bool over;
+
+   if (!p->base){
+      p->base = raw;
+      p->idleNs = now;
+      return;
+   }
+   thresh = div_u64((u64)p->base * READ_ONCE(touchThresholdPct), 100);
+   over = raw > p->base + (p->touched ? thresh / 2 : thresh);
+   if (over == p->touched) p->count = 0;
+   else if (++p->count >= TOUCH_DEBOUNCE){
+      p->count = 0;
+      p->touched = over;
+      if (over) WRITE_ONCE(touchLatencyNs, now - p->idleNs);
+      ebbgpio_queue_event(EBBGPIO_LINE_BUTTON, over ? EBBGPIO_EVENT_TOUCH : EBBGPIO_EVENT_RELEASE, i);
+      if (over && i == 0) ebbgpio_button_action();
+   }
+   if (!over && !p->touched){
+      p->base += ((s32)raw - (s32)p->base) >> TOUCH_BASE_SHIFT;
+      p->idleNs = now;
+   }
+}
+
+/** @brief The touch scanning kthread
+ *  All pads are discharged together, then released together and timed in one loop of bulk reads,
+ *  so a scan costs one charge time whatever the number of pads. Interrupts are off only while the
+ *  pads charge, for at most touchMaxLoops reads.
+ */
+static int ebbgpio_touch_run(void *arg){
+   u64 periodNs = NSEC_PER_SEC / touchScanHz, start, cost;
+   DECLARE_BITMAP(levels, EBBGPIO_TOUCH_MAX_PADS);
+   unsigned long pending, flags;
+   unsigned int i, loops, maxLoops;
+   ktime_t next = ktime_get();
+
+   while (!kthread_should_stop()){
+      maxLoops = READ_ONCE(touchMaxLoops);		// 1..TOUCH_MAX_LOOPS, the set op also runs at load time
+      start = ktime_get_ns();
+      for (i = 0; i < touchNumPads; i++) gpiod_direction_output_raw(touchDescs[i], 0);
+      udelay(TOUCH_DISCHARGE_US);
+      pending = BIT(touchNumPads) - 1;
+      local_irq_save(flags);
+      for (i = 0; i < touchNumPads; i++) gpiod_direction_input(touchDescs[i]);	// The pads charge from here
+      for (loops = 1; pending && loops < maxLoops; loops++){
+         if (gpiod_get_raw_array_value(touchNumPads, touchDescs, NULL, levels)) break;
+         for_each_set_bit(i, &pending, touchNumPads){
+            if (!test_bit(i, levels)) continue;
+            touchPad[i].raw = loops;
+            __clear_bit(i, &pending);
+         }
+      }
+      local_irq_restore(flags);
+      for_each_set_bit(i, &pending, touchNumPads) touchPad[i].raw = loops;	// Did not charge in time
+      cost = ktime_get_ns() - start;
+      for (i = 0; i < touchNumPads; i++) ebbgpio_touch_update(i, start);
+      WRITE_ONCE(touchScans, touchScans + 1);
+      WRITE_ONCE(touchScanNsTotal, touchScanNsTotal + cost);
+      if (cost > touchScanNsMax) WRITE_ONCE(touchScanNsMax, cost);
+
+      next = ktime_add_ns(next, periodNs);
+      if (ktime_before(next, ktime_get())) next = ktime_add_ns(ktime_get(), periodNs);	// Skip, do not burst
       set_current_state(TASK_INTERRUPTIBLE);
-      msleep(blinkPeriod/3);                		// millisecond sleep for half of the period
+      if (!kthread_should_stop()) schedule_hrtimeout_range(&next, periodNs / 8, HRTIMER_MODE_ABS);
+      __set_current_state(TASK_RUNNING);
+   }
+   return 0;
+}
+
+/** @brief Take over the button line and the extra pads for touch sensing
+ *  The pads need an external resistor to the supply, typically 1 MOhm, and must sit on a GPIO
+ *  controller that can be driven with interrupts off.
+ *  @return returns 0 if successful
+ */
+static int ebbgpio_touch_init(void){
+   unsigned int i, n;
+   int ret;
+
+   if (!touchScanHz || touchScanHz > 1000) return -EINVAL;
+   touchDescs[0] = gpio_to_desc(gpioButton);
+   for (n = 0; n < touchNumExtra; n++){
+      ret = gpio_request(touchPads[n], "touch");
+      if (ret) goto err_pads;
+      touchDescs[n + 1] = gpio_to_desc(touchPads[n]);
+   }
+   touchNumPads = touchNumExtra + 1;
+   for (i = 0; i < touchNumPads; i++){
+      if (!touchDescs[i] || gpiod_cansleep(touchDescs[i])){
+         ret = -EINVAL;
+         goto err_pads;
       }
-return 0;
+   }
+   touchTask = kthread_run(ebbgpio_touch_run, NULL, "LED_touch");
+   if (IS_ERR(touchTask)){
+      ret = PTR_ERR(touchTask);
+      goto err_pads;
+   }
+   printk(KERN_INFO "GPIO_TEST: Scanning %u touch pads at %u Hz\n", touchNumPads, touchScanHz);
+   return 0;
+
+err_pads:
+   while (n--) gpio_free(touchPads[n]);
+   return ret;
+}
+
+static void ebbgpio_touch_exit(void){
+   unsigned int i;
+
+   kthread_stop(touchTask);
+   for (i = 0; i < touchNumExtra; i++) gpio_free(touchPads[i]);
+}
+
+/// Snapshot of the touch sensing state
+static void ebbgpio_get_touch(struct ebbgpio_touch *t){
+   unsigned int i;
+
+   memset(t, 0, sizeof(*t));
+   if (!touchSense) return;
+   t->scans = READ_ONCE(touchScans);
+   t->scan_ns_total = READ_ONCE(touchScanNsTotal);
+   t->scan_ns_max = READ_ONCE(touchScanNsMax);
+   t->latency_ns = READ_ONCE(touchLatencyNs);
+   t->scan_hz = touchScanHz;
+   t->num_pads = touchNumPads;
+   for (i = 0; i < touchNumPads; i++){
+      t->touched |= READ_ONCE(touchPad[i].touched) << i;
+      t->raw[i] = READ_ONCE(touchPad[i].raw);
+      t->baseline[i] = READ_ONCE(touchPad[i].base);
+   }
+}
+
+/** @brief Ranging hrtimer, raises the trigger at the start of a slot and drops it 10 us later
+ *  Only one sensor owns each slot, so the burst of one sensor has died down before the next one
+ *  listens. A slot that ends with the echo still missing is a timeout.
+ */
+static enum hrtimer_restart ebbgpio_sonar_tick(struct hrtimer *t){
+   u64 now = ktime_get_ns(), late;
+
+   spin_lock(&sonarLock);
+   if (sonarTrigHigh){
+      gpio_set_value(sonarTrig[sonarActive], 0);
+      sonarTrigHigh = false;
+      sonarPulseMax = max(sonarPulseMax, ktime_get_ns() - sonarTrigNs);
+      sonarState = SONAR_ARMED;
+      hrtimer_set_expires(t, ktime_add_ms(sonarSlot, sonarSlotMs));
+      spin_unlock(&sonarLock);
+      return HRTIMER_RESTART;
+   }
+   if (sonarState != SONAR_IDLE) sonar[sonarActive].timeouts++;
+   sonarActive = (sonarActive + 1) % sonarNum;
+   sonarSlot = hrtimer_get_expires(t);
+   late = now - ktime_to_ns(sonarSlot);
+   sonarLateTotal += late;
+   sonarLateMax = max(sonarLateMax, late);
+   sonarTriggers++;
+   sonarState = SONAR_IDLE;
+   sonarTrigNs = ktime_get_ns();
+   gpio_set_value(sonarTrig[sonarActive], 1);
+   sonarTrigHigh = true;
+   hrtimer_set_expires(t, ns_to_ktime(sonarTrigNs + SONAR_TRIGGER_US * NSEC_PER_USEC));
+   spin_unlock(&sonarLock);
+   return HRTIMER_RESTART;
+}
+
+/** @brief Echo line IRQ, timestamps both edges and turns the pulse width into a distance
+ *  The echo is the round trip, so the distance is half of width times the speed of sound.
+ */
+static irqreturn_t ebbgpio_sonar_echo_irq(int irq, void *dev_id){
+   unsigned int i = (unsigned long)dev_id;
+   u64 now = ktime_get_ns(), width, mm;
+   bool level = gpio_get_value(sonarEcho[i]);
+   struct ebbgpio_sonar *s = &sonar[i];
+
+   spin_lock(&sonarLock);
+   if (i != sonarActive || sonarState == SONAR_IDLE) sonarStray++;	// Not this sensor's turn
+   else if (level && sonarState == SONAR_ARMED){
+      sonarRiseNs = now;
+      sonarState = SONAR_ECHO;
+   }
+   else if (!level && sonarState == SONAR_ECHO){
+      width = now - sonarRiseNs;
+      mm = div_u64(width * READ_ONCE(sonarSoundMmS), 2 * NSEC_PER_SEC);
+      if (mm <= READ_ONCE(sonarMaxMm)){
+         s->distance_mm = mm;
+         s->echo_ns = min_t(u64, width, U32_MAX);
+         s->timestamp_ns = now;
+         s->measurements++;
+      }
+      else s->timeouts++;
+      sonarState = SONAR_IDLE;
+   }
+   spin_unlock(&sonarLock);
+   return IRQ_HANDLED;
+}
+
+/** @brief Set up the ultrasonic sensors when trigger and echo GPIOs are given
+ *  @return returns 0 if successful
+ */
+static int ebbgpio_sonar_init(void){
+   unsigned int i;
+   int ret;
+
+   if (!sonarNumTrig && !sonarNumEcho) return 0;
+   if (sonarNumTrig != sonarNumEcho || sonarSlotMs < 10) return -EINVAL;
+   for (i = 0; i < sonarNumTrig; i++){
+      ret = gpio_request(sonarTrig[i], "sonar_trig");
+      if (ret) goto err;
+      ret = gpio_request(sonarEcho[i], "sonar_echo");
+      if (ret){
+         gpio_free(sonarTrig[i]);
+         goto err;
+      }
+      gpio_direction_output(sonarTrig[i], 0);
+      gpio_direction_input(sonarEcho[i]);
+      ret = request_irq(gpio_to_irq(sonarEcho[i]), ebbgpio_sonar_echo_irq,
+                        IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING, "ebb_sonar_echo", (void *)(unsigned long)i);
+      if (ret){
+         gpio_free(sonarEcho[i]);
+         gpio_free(sonarTrig[i]);
+         goto err;
+      }
+   }
+   sonarNum = sonarNumTrig;
+   sonarActive = sonarNum - 1;			// The first slot goes to sensor 0
+   hrtimer_setup(&sonarTimer, ebbgpio_sonar_tick, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+   hrtimer_start(&sonarTimer, ktime_get(), HRTIMER_MODE_ABS);
+   return 0;
+
+err:
+   while (i--){
+      free_irq(gpio_to_irq(sonarEcho[i]), (void *)(unsigned long)i);
+      gpio_free(sonarEcho[i]);
+      gpio_free(sonarTrig[i]);
+   }
+   return ret;
+}
+
+static void ebbgpio_sonar_exit(void){
+   unsigned int i;
+
+   if (!sonarNum) return;
+   hrtimer_cancel(&sonarTimer);
+   for (i = 0; i < sonarNum; i++){
+      free_irq(gpio_to_irq(sonarEcho[i]), (void *)(unsigned long)i);
+      gpio_set_value(sonarTrig[i], 0);
+      gpio_free(sonarEcho[i]);
+      gpio_free(sonarTrig[i]);
+   }
+   sonarNum = 0;
+}
+
+/// Snapshot of the ultrasonic results and timing
+static void ebbgpio_get_range(struct ebbgpio_range *r){
+   unsigned long flags;
+
+   memset(r, 0, sizeof(*r));
+   spin_lock_irqsave(&sonarLock, flags);
+   r->num_sensors = sonarNum;
+   r->slot_ms = sonarSlotMs;
+   r->triggers = sonarTriggers;
+   r->trigger_late_ns_total = sonarLateTotal;
+   r->trigger_late_ns_max = sonarLateMax;
+   r->pulse_ns_max = sonarPulseMax;
+   r->stray_edges = sonarStray;
+   memcpy(r->sensor, sonar, sizeof(sonar));
+   spin_unlock_irqrestore(&sonarLock, flags);
+}
+
+/// True for a frame a pattern may contain
+static bool ebbgpio_frame_valid(const struct ebbgpio_frame *f){
+   return f->duration_ms && !f->reserved && !(f->leds & ~(BIT(EBBGPIO_LINE_RED) | BIT(EBBGPIO_LINE_GREEN)));
+}
+
+/** @brief Check the frames of a new pattern and fill in the rest of it
+ *  @return returns 0 if successful, -EINVAL for a bad frame
+ */
+static int ebbgpio_pattern_prepare(struct ebb_pattern *p, u32 id, u32 numFrames){
+   u32 i, period = 0;
+
+   for (i = 0; i < numFrames; i++){
+      if (!ebbgpio_frame_valid(&p->frames[i])) return -EINVAL;
+      period += p->frames[i].duration_ms;
+   }
+   kref_init(&p->ref);
+   p->id = id;
+   p->periodMs = period;
+   p->numFrames = numFrames;
+   return 0;
+}
+
+/** @brief Put a pattern into the library, or delete the id when p is NULL
+ *  The library takes over p, which is freed on failure.
+ *  @return returns 0 if successful, -ENOSPC when patternMax patterns are already loaded
+ */
+static int ebbgpio_pattern_store(u32 id, struct ebb_pattern *p){
+   struct ebb_pattern *old;
+
+   mutex_lock(&patternLock);
+   if (p && patternCount >= READ_ONCE(patternMax) && !xa_load(&patterns, id)){
+      mutex_unlock(&patternLock);
+      kfree(p);
+      return -ENOSPC;
+   }
+   old = p ? xa_store(&patterns, id, p, GFP_KERNEL) : xa_erase(&patterns, id);
+   if (xa_is_err(old)){
+      mutex_unlock(&patternLock);
+      kfree(p);
+      return xa_err(old);
+   }
+   if (p && !old) patternCount++;
+   else if (!p && old) patternCount--;
+   if (p) WRITE_ONCE(patternBytes, patternBytes + struct_size(p, frames, p->numFrames));
+   if (old) WRITE_ONCE(patternBytes, patternBytes - struct_size(old, frames, old->numFrames));
+   mutex_unlock(&patternLock);
+   if (old) kref_put(&old->ref, ebb_pattern_release);	// Instances playing it hold their own reference
+   return 0;
+}
+
+/** @brief Add, replace or delete a pattern of the shared library
+ *  @return returns 0 if successful, -ENOSPC when patternMax patterns are already loaded
+ */
+static long ebbgpio_pattern_load(struct ebbgpio_pattern __user *arg){
+   struct ebbgpio_pattern req;
+   struct ebb_pattern *p = NULL;
+
+   if (copy_from_user(&req, arg, sizeof(req))) return -EFAULT;
+   if (!req.id || req.num_frames > EBBGPIO_PATTERN_MAX_FRAMES) return -EINVAL;
+   if (req.num_frames){
+      p = kmalloc(struct_size(p, frames, req.num_frames), GFP_KERNEL);
+      if (!p) return -ENOMEM;
+      if (copy_from_user(p->frames, u64_to_user_ptr(req.frames), array_size(req.num_frames, sizeof(p->frames[0])))){
+         kfree(p);
+         return -EFAULT;
+      }
+      if (ebbgpio_pattern_prepare(p, req.id, req.num_frames)){
+         kfree(p);
+         return -EINVAL;
+      }
+   }
+   return ebbgpio_pattern_store(req.id, p);
+}
+
+/** @brief Show a pattern of the library in FLASH, id 0 for the plain blink
+ *  @return returns 0 if successful, -ENOENT for an unknown pattern
+ */
+static int ebbgpio_pattern_select(u32 id, u32 phaseMs){
+   struct ebb_pattern *p = NULL, *old;
+
+   if (id){
+      rcu_read_lock();
+      p = xa_load(&patterns, id);
+      if (p && !kref_get_unless_zero(&p->ref)) p = NULL;	// Lost a race with its replacement
+      rcu_read_unlock();
+      if (!p) return -ENOENT;
+   }
+   mutex_lock(&patternLock);
+   WRITE_ONCE(ebb.patternPhaseMs, phaseMs);
+   old = rcu_replace_pointer(ebb.pattern, p, lockdep_is_held(&patternLock));
+   mutex_unlock(&patternLock);
+   if (old) kref_put(&old->ref, ebb_pattern_release);
+   ebbgpio_kick_thread();
+   return 0;
+}
+
+/** @brief Select the pattern the instance shows in FLASH
+ *  @return returns 0 if successful, -ENOENT for an unknown pattern
+ */
+static long ebbgpio_pattern_play(struct ebbgpio_pattern_play __user *arg){
+   struct ebbgpio_pattern_play req;
+
+   if (copy_from_user(&req, arg, sizeof(req))) return -EFAULT;
+   return ebbgpio_pattern_select(req.id, req.phase_ms);
+}
+
+/// Drop the instance's pattern and empty the library, once nothing can play or load patterns
+static void ebbgpio_pattern_exit(void){
+   struct ebb_pattern *p;
+   unsigned long id;
+
+   p = rcu_replace_pointer(ebb.pattern, NULL, true);
+   if (p) kref_put(&p->ref, ebb_pattern_release);
+   xa_for_each(&patterns, id, p){
+      xa_erase(&patterns, id);
+      kref_put(&p->ref, ebb_pattern_release);
+   }
+   patternCount = 0;
+   patternBytes = 0;
+}
+
+/// Quantiles and SLO state of the tracked latencies, computed from the live sketches
+static void ebbgpio_get_latency(struct ebbgpio_latency *lat){
+   struct ebbgpio_quantiles *q;
+   struct ebb_latency *l;
+   unsigned int i;
+
+   memset(lat, 0, sizeof(*lat));
+   for (i = 0; i < EBBGPIO_LAT_NUM; i++){
+      l = &ebb.lat[i];
+      q = &lat->metric[i];
+      q->count = READ_ONCE(l->samples);
+      q->p50_ns = ebb_sketch_quantile(&l->all, 5000);
+      q->p99_ns = ebb_sketch_quantile(&l->all, 9900);
+      q->p999_ns = ebb_sketch_quantile(&l->all, 9990);
+      q->slo_us = READ_ONCE(sloUs[i]);
+      q->alarmed = READ_ONCE(l->alarmed);
+      q->alarms = READ_ONCE(l->alarms);
+   }
+}
+
+/// Snapshot of the blink deadline accounting, the counters may be mid update
+static void ebbgpio_get_timing(struct ebbgpio_timing *t){
+   unsigned int i;
+
+   memset(t, 0, sizeof(*t));
+   t->deadlines = READ_ONCE(ebb.blinkDeadlines);
+   t->misses = READ_ONCE(ebb.blinkMisses);
+   t->skipped = READ_ONCE(ebb.blinkSkipped);
+   t->late_max_ns = READ_ONCE(ebb.blinkLateMaxNs);
+   t->late_total_ns = READ_ONCE(ebb.blinkLateTotalNs);
+   t->overrun = READ_ONCE(ebb.blinkOverrun);
+   t->degrade_shift = READ_ONCE(ebb.blinkDegradeShift);
+   for (i = 0; i < EBBGPIO_LATE_BUCKETS; i++) t->late_hist[i] = READ_ONCE(ebb.blinkLateHist[i]);
+}
+
+/// Snapshot of the driver counters
+static void ebbgpio_get_stats(struct ebbgpio_stats *stats){
+   memset(stats, 0, sizeof(*stats));
+   stats->presses = READ_ONCE(ebb.numberPresses);
+   stats->events_dropped = READ_ONCE(devQueue.dropped);
+   stats->blink_wakeups = READ_ONCE(ebb.blinkWakeups);
+   stats->strip_frames = READ_ONCE(stripFrames);
+   stats->strip_frame_ns = READ_ONCE(stripFrameNs);
+   stats->strip_frame_ns_total = READ_ONCE(stripFrameNsTotal);
+   stats->strip_cpu_ns = READ_ONCE(stripCpuNs);
+   stats->strip_cpu_ns_total = READ_ONCE(stripCpuNsTotal);
+   stats->vlc_tx_frames = READ_ONCE(vlcTxFrames);
+   stats->vlc_rx_frames = READ_ONCE(vlcRxFrames);
+   stats->vlc_rx_errors = READ_ONCE(vlcRxErrors);
+   stats->vlc_rx_dropped = READ_ONCE(vlcRxDropped);
+   stats->idle_entries = READ_ONCE(idleEntries);
+   stats->instance_bytes = sizeof(struct ebb_instance);
+   stats->patterns = READ_ONCE(patternCount);
+   stats->pattern_bytes = READ_ONCE(patternBytes);
+}
+
+/** @brief Validate and apply a new LED configuration
+ *  The mode and period become the lowest priority request, shown whenever no other client
+ *  asks for something else.
+ *  @return returns 0 if successful, -EINVAL for a bad mode or period
+ */
+static int ebbgpio_apply_config(const struct ebbgpio_config *cfg){
+   if (cfg->mode > EBBGPIO_MODE_FLASH || cfg->blink_period_ms == 0) return -EINVAL;
+   WRITE_ONCE(ebb.blinkSlackUs[EBBGPIO_LINE_RED], cfg->slack_us[EBBGPIO_LINE_RED]);
+   WRITE_ONCE(ebb.blinkSlackUs[EBBGPIO_LINE_GREEN], cfg->slack_us[EBBGPIO_LINE_GREEN]);
+   ebbgpio_post_request(EBBGPIO_CLIENT_CONFIG, EBBGPIO_PRIO_CONFIG, cfg->mode, cfg->blink_period_ms, 0);
+   if (genl_has_listeners(&ebbgpio_genl_family, &init_net, 0)){
+      set_bit(0, &nlConfigChanged);
+      schedule_work(&nlWork);
+   }
+   return 0;
+}
+
+/** @brief Post or withdraw an application's request from user space
+ *  The clients owned by the driver itself cannot be changed this way.
+ *  @return returns 0 if successful
+ */
+static long ebbgpio_user_request(struct ebbgpio_request __user *arg){
+   struct ebbgpio_request req;
+
+   if (copy_from_user(&req, arg, sizeof(req))) return -EFAULT;
+   if (req.client < EBBGPIO_CLIENT_FIRST_APP || (req.flags & ~EBBGPIO_REQUEST_CLEAR)) return -EINVAL;
+   if (req.flags & EBBGPIO_REQUEST_CLEAR) return ebbgpio_clear_request(req.client);
+   return ebbgpio_post_request(req.client, req.priority, req.mode, req.blink_period_ms, req.timeout_ms);
+}
+
+/// Report which request is shown right now
+static void ebbgpio_get_effective(struct ebbgpio_effective *eff){
+   unsigned long flags;
+   unsigned int prio;
+
+   memset(eff, 0, sizeof(*eff));
+   spin_lock_irqsave(&arbLock, flags);
+   eff->client = arbWinner;
+   eff->priority = arbSlots[arbWinner].priority;
+   eff->mode = ebb.mode;
+   eff->blink_period_ms = ebb.blinkPeriod;
+   for (prio = 0; prio <= EBBGPIO_MAX_PRIORITY; prio++) eff->active_clients |= arbPrioClients[prio];
+   spin_unlock_irqrestore(&arbLock, flags);
+}
+
+/// A frame of a blob pattern in CPU byte order, the blob stores the duration little endian
+static struct ebbgpio_frame ebbgpio_blob_frame(const struct ebbgpio_frame *raw){
+   struct ebbgpio_frame f = *raw;
+
+   f.duration_ms = le16_to_cpu((__force __le16)raw->duration_ms);
+   return f;
+}
+
+/** @brief Check one record of a configuration blob, and apply it when apply is set
+ *  @return returns 0 if successful, -EINVAL for an unknown tag or a bad payload
+ */
+static int ebbgpio_blob_record(u16 tag, const void *payload, u16 len, bool apply){
+   const struct ebbgpio_blob_pattern *bp = payload;
+   const struct ebbgpio_blob_idle *bi = payload;
+   const struct ebbgpio_frame *bf = (const void *)(bp + 1);
+   const __le32 *words = payload;
+   struct ebbgpio_config cfg;
+   struct ebbgpio_request req;
+   struct ebbgpio_frame f;
+   struct ebb_pattern *p;
+   u32 i, n, id, timeout;
+   int ret;
+
+   switch (tag){
+   case EBBGPIO_BLOB_CONFIG:
+      if (len != sizeof(cfg)) return -EINVAL;
+      cfg.mode = le32_to_cpu(words[0]);
+      cfg.blink_period_ms = le32_to_cpu(words[1]);
+      cfg.slack_us[EBBGPIO_LINE_RED] = le32_to_cpu(words[2]);
+      cfg.slack_us[EBBGPIO_LINE_GREEN] = le32_to_cpu(words[3]);
+      if (cfg.mode > EBBGPIO_MODE_FLASH || cfg.blink_period_ms == 0) return -EINVAL;
+      return apply ? ebbgpio_apply_config(&cfg) : 0;
+   case EBBGPIO_BLOB_PATTERN:
+      if (len < sizeof(*bp) || (len - sizeof(*bp)) % sizeof(*bf)) return -EINVAL;
+      n = (len - sizeof(*bp)) / sizeof(*bf);
+      id = le32_to_cpu(bp->id);
+      if (!id || !n || n > EBBGPIO_PATTERN_MAX_FRAMES || (le32_to_cpu(bp->flags) & ~EBBGPIO_BLOB_PATTERN_PLAY))
+         return -EINVAL;
+      if (!apply){
+         for (i = 0; i < n; i++){
+            f = ebbgpio_blob_frame(&bf[i]);
+            if (!ebbgpio_frame_valid(&f)) return -EINVAL;
+         }
+         return 0;
+      }
+      p = kmalloc(struct_size(p, frames, n), GFP_KERNEL);
+      if (!p) return -ENOMEM;
+      for (i = 0; i < n; i++) p->frames[i] = ebbgpio_blob_frame(&bf[i]);
+      ebbgpio_pattern_prepare(p, id, n);
+      ret = ebbgpio_pattern_store(id, p);
+      if (ret || !(le32_to_cpu(bp->flags) & EBBGPIO_BLOB_PATTERN_PLAY)) return ret;
+      return ebbgpio_pattern_select(id, 0);
+   case EBBGPIO_BLOB_IDLE:
+      if (len != sizeof(*bi) || le32_to_cpu(bi->mode) > EBBGPIO_MODE_FLASH || !le32_to_cpu(bi->blink_period_ms))
+         return -EINVAL;
+      if (!apply) return 0;
+      WRITE_ONCE(idleMode, le32_to_cpu(bi->mode));
+      WRITE_ONCE(idleBlinkPeriod, le32_to_cpu(bi->blink_period_ms));
+      timeout = le32_to_cpu(bi->timeout_s);
+      idleTimeoutS = timeout;
+      if (timeout) mod_timer(&idleTimer, READ_ONCE(ebb.lastInput) + (unsigned long)timeout * HZ);
+      else timer_delete(&idleTimer);
+      return 0;
+   case EBBGPIO_BLOB_REQUEST:
+      if (len != sizeof(req)) return -EINVAL;
+      req.client = le32_to_cpu(words[0]);
+      req.priority = le32_to_cpu(words[1]);
+      req.mode = le32_to_cpu(words[2]);
+      req.blink_period_ms = le32_to_cpu(words[3]);
+      req.timeout_ms = le32_to_cpu(words[4]);
+      req.flags = le32_to_cpu(words[5]);
+      // Same rules as EBBGPIO_IOC_POST_REQUEST, so ebbgpio_post_request() cannot fail below
+      if (req.client < EBBGPIO_CLIENT_FIRST_APP || req.client >= EBBGPIO_MAX_CLIENTS || req.flags ||
+          req.priority > EBBGPIO_MAX_PRIORITY || req.mode > EBBGPIO_MODE_FLASH || !req.blink_period_ms)
+         return -EINVAL;
+      return apply ? ebbgpio_post_request(req.client, req.priority, req.mode, req.blink_period_ms, req.timeout_ms) : 0;
+   default:
+      return -EINVAL;
+   }
+}
+
+/** @brief Validate a configuration blob and apply all of its records in one pass
+ *  The checksum, the framing and the contents of every record are checked before anything is
+ *  applied, so a bad record anywhere leaves the defaults untouched. Only running out of memory
+ *  for a pattern can still stop it half way.
+ *  @return returns 0 if successful
+ */
+static int ebbgpio_apply_blob(const u8 *data, size_t size){
+   const struct ebbgpio_blob_header *hdr = (const void *)data;
+   const struct ebbgpio_blob_record *rec;
+   unsigned int i, num, numPatterns = 0;
+   size_t off, len;
+   int ret;
+
+   if (size < sizeof(*hdr) || le32_to_cpu(hdr->magic) != EBBGPIO_BLOB_MAGIC ||
+       le16_to_cpu(hdr->version) != EBBGPIO_BLOB_VERSION || le32_to_cpu(hdr->length) != size - sizeof(*hdr))
+      return -EINVAL;
+   if ((crc32_le(~0, data + sizeof(*hdr), size - sizeof(*hdr)) ^ ~0) != le32_to_cpu(hdr->crc32))
+      return -EBADMSG;
+   num = le16_to_cpu(hdr->num_records);
+   for (i = 0, off = sizeof(*hdr); i < num; i++, off += sizeof(*rec) + ALIGN(len, 4)){
+      if (size - off < sizeof(*rec)) return -EINVAL;
+      rec = (const void *)(data + off);
+      len = le16_to_cpu(rec->length);
+      if (size - off - sizeof(*rec) < ALIGN(len, 4)) return -EINVAL;
+      ret = ebbgpio_blob_record(le16_to_cpu(rec->tag), rec + 1, len, false);
+      if (ret) return ret;
+      if (le16_to_cpu(rec->tag) == EBBGPIO_BLOB_PATTERN) numPatterns++;
+   }
+   if (off != size || numPatterns > READ_ONCE(patternMax)) return -EINVAL;	// The library is empty at load time
+   for (i = 0, off = sizeof(*hdr); i < num; i++, off += sizeof(*rec) + ALIGN(len, 4)){
+      rec = (const void *)(data + off);
+      len = le16_to_cpu(rec->length);
+      ret = ebbgpio_blob_record(le16_to_cpu(rec->tag), rec + 1, len, true);
+      if (ret) return ret;
+   }
+   return 0;
+}
+
+/** @brief Load the boot configuration blob, if there is one
+ *  A missing or broken blob is not fatal, the driver then starts with its built-in defaults.
+ *  The file can come from /lib/firmware or from the initramfs, and is applied before the LEDs
+ *  are driven so that their first state is already the configured one.
+ */
+static void ebbgpio_load_blob(void){
+   const struct firmware *fw;
+   ktime_t start = ktime_get();
+   int ret;
+
+   if (!configBlob || !*configBlob) return;
+   ret = firmware_request_nowarn(&fw, configBlob, NULL);
+   if (ret){
+      if (ret != -ENOENT) printk(KERN_WARNING "GPIO_TEST: cannot load %s: %d\n", configBlob, ret);
+      return;
+   }
+   ret = ebbgpio_apply_blob(fw->data, fw->size);
+   release_firmware(fw);
+   if (ret) printk(KERN_WARNING "GPIO_TEST: ignoring invalid %s: %d\n", configBlob, ret);
+   else printk(KERN_INFO "GPIO_TEST: applied %s in %lld us\n", configBlob, ktime_us_delta(ktime_get(), start));
+}
+
+/** @brief Apply an optional configuration, then drain queued events into a user buffer
+ *  This lets one ioctl or one io_uring submission reconfigure the LEDs and fetch an event batch.
+ *  @return the number of events copied, or a negative errno
+ */
+static long ebbgpio_xfer(struct ebbgpio_xfer __user *arg){
+   struct ebbgpio_event events[16];
+   struct ebbgpio_event __user *dst;
+   struct ebbgpio_xfer x;
+   unsigned int done = 0, n;
+   int ret;
+
+   if (copy_from_user(&x, arg, sizeof(x))) return -EFAULT;
+   if (x.flags & ~EBBGPIO_XFER_SET_CONFIG) return -EINVAL;
+   if (x.flags & EBBGPIO_XFER_SET_CONFIG){
+      ret = ebbgpio_apply_config(&x.config);
+      if (ret) return ret;
+   }
+   dst = u64_to_user_ptr(x.events);
+   while (done < x.max_events){
+      n = ebbgpio_queue_fetch(&devQueue, events, min_t(u32, x.max_events - done, ARRAY_SIZE(events)));
+      if (!n) break;
+      if (copy_to_user(dst + done, events, n * sizeof(*events))) return -EFAULT;
+      done += n;
+   }
+   return done;
+}
+
+/** @brief Does the command sleep (allocate, take a mutex, start or stop a thread)?
+ *  Those are not run from the io_uring submission path, see ebbgpio_uring_cmd().
+ */
+static bool ebbgpio_cmd_sleeps(unsigned int cmd){
+   switch (cmd){
+   case EBBGPIO_IOC_LINE_REQUEST:
+   case EBBGPIO_IOC_CAPTURE:
+   case EBBGPIO_IOC_STRIP_FRAME:
+   case EBBGPIO_IOC_PATTERN_LOAD:
+   case EBBGPIO_IOC_PATTERN_PLAY:
+      return true;
+   default:
+      return false;
+   }
+}
+
+/** @brief Execute one control command
+ *  Shared by the ioctl and the io_uring passthrough paths, so both accept exactly the same
+ *  commands and arguments. The commands listed by ebbgpio_cmd_sleeps() may sleep.
+ *  @param cmd one of the EBBGPIO_IOC_* numbers
+ *  @param arg user pointer to the command argument
+ */
+static long ebbgpio_do_cmd(unsigned int cmd, void __user *arg){
+   struct ebbgpio_config cfg;
+   struct ebbgpio_stats stats;
+   struct ebbgpio_effective eff;
+   struct ebbgpio_timing timing;
+   struct ebbgpio_touch touch;
+   struct ebbgpio_range range;
+   struct ebbgpio_latency lat;
+
+   switch (cmd){
+   case EBBGPIO_IOC_GET_CONFIG:
+      ebbgpio_get_config(&cfg);
+      return copy_to_user(arg, &cfg, sizeof(cfg)) ? -EFAULT : 0;
+   case EBBGPIO_IOC_SET_CONFIG:
+      if (copy_from_user(&cfg, arg, sizeof(cfg))) return -EFAULT;
+      return ebbgpio_apply_config(&cfg);
+   case EBBGPIO_IOC_GET_STATS:
+      ebbgpio_get_stats(&stats);
+      return copy_to_user(arg, &stats, sizeof(stats)) ? -EFAULT : 0;
+   case EBBGPIO_IOC_XFER:
+      return ebbgpio_xfer(arg);
+   case EBBGPIO_IOC_LINE_REQUEST:
+      return ebbgpio_line_request(arg);
+   case EBBGPIO_IOC_CAPTURE:
+      return ebbgpio_capture(arg);
+   case EBBGPIO_IOC_POST_REQUEST:
+      return ebbgpio_user_request(arg);
+   case EBBGPIO_IOC_RESYNC:
+      return ebbgpio_queue_resync(&devQueue, arg);
+   case EBBGPIO_IOC_STRIP_FRAME:
+      return ebbgpio_strip_frame(arg);
+   case EBBGPIO_IOC_GET_EFFECTIVE:
+      ebbgpio_get_effective(&eff);
+      return copy_to_user(arg, &eff, sizeof(eff)) ? -EFAULT : 0;
+   case EBBGPIO_IOC_GET_TIMING:
+      ebbgpio_get_timing(&timing);
+      return copy_to_user(arg, &timing, sizeof(timing)) ? -EFAULT : 0;
+   case EBBGPIO_IOC_GET_TOUCH:
+      ebbgpio_get_touch(&touch);
+      return copy_to_user(arg, &touch, sizeof(touch)) ? -EFAULT : 0;
+   case EBBGPIO_IOC_GET_RANGE:
+      ebbgpio_get_range(&range);
+      return copy_to_user(arg, &range, sizeof(range)) ? -EFAULT : 0;
+   case EBBGPIO_IOC_GET_LATENCY:
+      ebbgpio_get_latency(&lat);
+      return copy_to_user(arg, &lat, sizeof(lat)) ? -EFAULT : 0;
+   case EBBGPIO_IOC_PATTERN_LOAD:
+      return ebbgpio_pattern_load(arg);
+   case EBBGPIO_IOC_PATTERN_PLAY:
+      return ebbgpio_pattern_play(arg);
+   default:
+      return -ENOTTY;
+   }
+}
+
+/** @brief Reply to a generic netlink request with a single binary attribute
+ *  @return returns 0 if successful
+ */
+static int ebbgpio_genl_reply(struct genl_info *info, u8 cmd, int attr, const void *data, int len){
+   struct sk_buff *skb;
+   void *hdr;
+
+   skb = genlmsg_new(nla_total_size(len), GFP_KERNEL);
+   if (!skb) return -ENOMEM;
+   hdr = genlmsg_put_reply(skb, info, &ebbgpio_genl_family, 0, cmd);
+   if (!hdr || nla_put(skb, attr, len, data)){
+      nlmsg_free(skb);
+      return -EMSGSIZE;
+   }
+   genlmsg_end(skb, hdr);
+   return genlmsg_reply(skb, info);
+}
+
+static int ebbgpio_genl_get_config(struct sk_buff *skb, struct genl_info *info){
+   struct ebbgpio_config cfg;
+
+   ebbgpio_get_config(&cfg);
+   return ebbgpio_genl_reply(info, EBBGPIO_CMD_GET_CONFIG, EBBGPIO_ATTR_CONFIG, &cfg, sizeof(cfg));
+}
+
+static int ebbgpio_genl_set_config(struct sk_buff *skb, struct genl_info *info){
+   struct ebbgpio_config cfg;
+
+   if (!info->attrs[EBBGPIO_ATTR_CONFIG]) return -EINVAL;
+   memcpy(&cfg, nla_data(info->attrs[EBBGPIO_ATTR_CONFIG]), sizeof(cfg));
+   return ebbgpio_apply_config(&cfg);
+}
+
+static int ebbgpio_genl_get_stats(struct sk_buff *skb, struct genl_info *info){
+   struct ebbgpio_stats stats;
+
+   ebbgpio_get_stats(&stats);
+   return ebbgpio_genl_reply(info, EBBGPIO_CMD_GET_STATS, EBBGPIO_ATTR_STATS, &stats, sizeof(stats));
+}
+
+/// Multicast the current configuration after a change
+static void ebbgpio_genl_notify_config(void){
+   struct ebbgpio_config cfg;
+   struct sk_buff *skb;
+   void *hdr;
+
+   skb = genlmsg_new(nla_total_size(sizeof(cfg)), GFP_KERNEL);
+   if (!skb) return;
+   hdr = genlmsg_put(skb, 0, 0, &ebbgpio_genl_family, 0, EBBGPIO_CMD_CONFIG_CHANGED);
+   ebbgpio_get_config(&cfg);
+   if (!hdr || nla_put(skb, EBBGPIO_ATTR_CONFIG, sizeof(cfg), &cfg)){
+      nlmsg_free(skb);
+      return;
+   }
+   genlmsg_end(skb, hdr);
+   genlmsg_multicast(&ebbgpio_genl_family, skb, 0, 0, GFP_KERNEL);
+}
+
+/** @brief Multicast the queued events, as many per message as fit
+ *  One skb is built per batch and shared by every listener of the events group. Events that
+ *  arrive while a batch is being sent simply join the next one, so the cost per event falls
+ *  as the event rate rises.
+ */
+static void ebbgpio_genl_work(struct work_struct *work){
+   struct ebbgpio_event events[16];
+   struct sk_buff *skb;
+   unsigned int room, n, i;
+   void *hdr;
+
+   if (test_and_clear_bit(0, &nlConfigChanged)) ebbgpio_genl_notify_config();
+   while (!kfifo_is_empty(&nlQueue.fifo)){
+      skb = genlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
+      if (!skb) return;
+      hdr = genlmsg_put(skb, 0, 0, &ebbgpio_genl_family, 0, EBBGPIO_CMD_EVENTS);
+      if (!hdr){
+         nlmsg_free(skb);
+         return;
+      }
+      for (;;){
+         room = skb_tailroom(skb) / nla_total_size(sizeof(*events));
+         n = ebbgpio_queue_fetch(&nlQueue, events, min_t(unsigned int, room, ARRAY_SIZE(events)));
+         if (!n) break;
+         for (i = 0; i < n; i++) nla_put(skb, EBBGPIO_ATTR_EVENT, sizeof(*events), &events[i]);
+      }
+      genlmsg_end(skb, hdr);
+      genlmsg_multicast(&ebbgpio_genl_family, skb, 0, 0, GFP_KERNEL);
+   }
+}
+
+static const struct nla_policy ebbgpio_genl_policy[EBBGPIO_ATTR_MAX + 1] = {
+   [EBBGPIO_ATTR_CONFIG] = NLA_POLICY_EXACT_LEN(sizeof(struct ebbgpio_config)),
+};
+
+static const struct genl_small_ops ebbgpio_genl_ops[] = {
+   {
+      .cmd  = EBBGPIO_CMD_GET_CONFIG,
+      .doit = ebbgpio_genl_get_config,
+   },
+   {
+      .cmd   = EBBGPIO_CMD_SET_CONFIG,
+      .doit  = ebbgpio_genl_set_config,
+      .flags = GENL_ADMIN_PERM,
+   },
+   {
+      .cmd  = EBBGPIO_CMD_GET_STATS,
+      .doit = ebbgpio_genl_get_stats,
+   },
+};
+
+static const struct genl_multicast_group ebbgpio_genl_mcgrps[] = {
+   { .name = EBBGPIO_GENL_MCGRP_EVENTS },
+};
+
+static struct genl_family ebbgpio_genl_family = {
+   .name          = EBBGPIO_GENL_NAME,
+   .version       = EBBGPIO_GENL_VERSION,
+   .maxattr       = EBBGPIO_ATTR_MAX,
+   .policy        = ebbgpio_genl_policy,
+   .module        = THIS_MODULE,
+   .small_ops     = ebbgpio_genl_ops,
+   .n_small_ops   = ARRAY_SIZE(ebbgpio_genl_ops),
+   .resv_start_op = EBBGPIO_CMD_CONFIG_CHANGED + 1,
+   .mcgrps        = ebbgpio_genl_mcgrps,
+   .n_mcgrps      = ARRAY_SIZE(ebbgpio_genl_mcgrps),
+};
+
+static long ebbgpio_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
+   return ebbgpio_do_cmd(cmd, (void __user *)arg);
+}
+
+/** @brief IORING_OP_URING_CMD handler
+ *  The command op carries the ioctl number and the SQE command area a struct ebbgpio_uring_cmd.
+ *  Commands complete inline, the return value becomes the CQE result. Sleeping commands are
+ *  refused with -EAGAIN on the non-blocking issue, so io_uring retries them from a worker.
+ */
+static int ebbgpio_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags){
+   const struct ebbgpio_uring_cmd *ucmd = io_uring_sqe_cmd(ioucmd->sqe);
+
+   if (READ_ONCE(ucmd->reserved)) return -EINVAL;
+   // Commands that may sleep go to the io-wq workers
+   if ((issue_flags & IO_URING_F_NONBLOCK) && ebbgpio_cmd_sleeps(ioucmd->cmd_op)) return -EAGAIN;
+   return ebbgpio_do_cmd(ioucmd->cmd_op, u64_to_user_ptr(READ_ONCE(ucmd->addr)));
+}
+
+static ssize_t ebbgpio_read_iter(struct kiocb *iocb, struct iov_iter *to){
+   return ebbgpio_queue_read(&devQueue, iocb, to);
+}
+
+static __poll_t ebbgpio_poll(struct file *file, poll_table *wait){
+   return ebbgpio_queue_poll(&devQueue, file, wait);
+}
+
+/** @brief Map the capture buffer read-only
+ *  The buffer lives as long as the module, and an open mapping holds the module through the file.
+ */
+static int ebbgpio_mmap(struct file *file, struct vm_area_struct *vma){
+   if (vma->vm_flags & VM_WRITE) return -EPERM;
+   vm_flags_clear(vma, VM_MAYWRITE);
+   return remap_vmalloc_range(vma, captureBuf, vma->vm_pgoff);
+}
+
+static int ebbgpio_open(struct inode *inode, struct file *file){
+   file->f_mode |= FMODE_NOWAIT;            // read_iter honours IOCB_NOWAIT, see above
+   return stream_open(inode, file);
+}
+
+static const struct file_operations ebbgpio_fops = {
+   .owner          = THIS_MODULE,
+   .open           = ebbgpio_open,
+   .read_iter      = ebbgpio_read_iter,
+   .splice_read    = copy_splice_read,      // splice() and sendfile() into pipes, files and sockets
+   .poll           = ebbgpio_poll,
+   .mmap           = ebbgpio_mmap,
+   .unlocked_ioctl = ebbgpio_ioctl,
+   .compat_ioctl   = compat_ptr_ioctl,
+   .uring_cmd      = ebbgpio_uring_cmd,
+};
+
+static struct miscdevice ebbgpio_misc = {
+   .minor = MISC_DYNAMIC_MINOR,
+   .name  = "ebbgpio",                      // Appears as /dev/ebbgpio
+   .fops  = &ebbgpio_fops,
+   .mode  = 0660,
+};
+
+
+#ifndef MODULE
+static unsigned int bootBlinkMs = 		100;		///< Toggle interval of the boot pattern
+module_param(bootBlinkMs, uint, S_IRUGO);
+MODULE_PARM_DESC(bootBlinkMs, " Built-in only: toggle interval of the boot progress pattern in ms (default=100)");
+static unsigned int bootHoldMs = 		10000;		///< How long the pattern stays up after the handover
+module_param(bootHoldMs, uint, S_IRUGO);
+MODULE_PARM_DESC(bootHoldMs, " Built-in only: time the boot pattern keeps running once the driver is up (default=10000)");
+static struct timer_list bootTimer;
+static bool bootActive, bootPhase;
+
+/// Alternate the two LEDs, so the board visibly makes progress while it boots
+static void ebbgpio_boot_tick(struct timer_list *t){
+   bootPhase = !bootPhase;
+   gpio_set_value(gpioLedRED, bootPhase);
+   gpio_set_value(gpioLedGREEN, !bootPhase);
+   mod_timer(&bootTimer, jiffies + msecs_to_jiffies(bootBlinkMs));
+}
+
+/** @brief Start the boot pattern as soon as the GPIO controllers are up
+ *  Runs long before the driver proper, which needs misc, netlink and firmware loading. If the
+ *  LED GPIOs are not there yet the pattern is simply skipped.
+ *  @return always 0, the boot pattern is best effort
+ */
+static int __init ebbgpio_boot_init(void){
+   if (gpio_request(gpioLedRED, "boot")) return 0;
+   if (gpio_request(gpioLedGREEN, "boot")){
+      gpio_free(gpioLedRED);
+      return 0;
+   }
+   gpio_direction_output(gpioLedRED, 1);
+   gpio_direction_output(gpioLedGREEN, 0);
+   printk(KERN_INFO "GPIO_TEST: Boot pattern on the LEDs %llu ms after boot\n", div_u64(ktime_get_boottime_ns(), NSEC_PER_MSEC));
+   timer_setup(&bootTimer, ebbgpio_boot_tick, 0);
+   mod_timer(&bootTimer, jiffies + msecs_to_jiffies(bootBlinkMs));
+   bootActive = true;
+   return 0;
+}
+subsys_initcall(ebbgpio_boot_init);
+
+/** @brief Hand the LEDs from the boot pattern over to the driver without a dark gap
+ *  The pattern continues as the BOOT request, at the same rate, until bootHoldMs runs out and
+ *  the configured mode shows. The GPIOs keep their levels until the driver requests them again.
+ */
+static void __init ebbgpio_boot_handover(void){
+   if (!bootActive) return;
+   timer_shutdown_sync(&bootTimer);
+   gpio_free(gpioLedRED);
+   gpio_free(gpioLedGREEN);
+   bootActive = false;
+   currentStateLedRED = bootPhase;
+   currentStateLedGREEN = !bootPhase;
+   ebb.ledOn = !bootPhase;                  // The thread toggles first, back to the levels shown now
+   if (bootHoldMs) ebbgpio_post_request(EBBGPIO_CLIENT_BOOT, EBBGPIO_PRIO_BOOT, EBBGPIO_MODE_FLASH,
+                                        max(bootBlinkMs * 3, 1U), bootHoldMs);	// The thread toggles every period/3
 }
 
+/// Stop the boot pattern and release its GPIOs, when the driver fails before the handover
+static void __init ebbgpio_boot_stop(void){
+   if (!bootActive) return;
+   timer_shutdown_sync(&bootTimer);
+   gpio_set_value(gpioLedRED, 0);
+   gpio_set_value(gpioLedGREEN, 0);
+   gpio_free(gpioLedRED);
+   gpio_free(gpioLedGREEN);
+   bootActive = false;
+}
+#else
+static inline void ebbgpio_boot_handover(void){}
+static inline void ebbgpio_boot_stop(void){}
+#endif
 
 /** @brief The LKM initialization function
  *  The static keyword restricts the visibility of the function to within this C file. The __init
@@ -62,8 +2829,6 @@ return 0;
  *  function sets up the GPIOs and the IRQ
  *  @return returns 0 if successful
  */
-
-
 static int __init ebbgpio_init(void){
    int result = 0;
    printk(KERN_INFO "GPIO_TEST: Initializing the GPIO_TEST LKM\n");
@@ -72,6 +2837,17 @@ static int __init ebbgpio_init(void){
       printk(KERN_INFO "GPIO_TEST: invalid LED:RED/GREEN GPIO\n");
       return -ENODEV;
    }
+   result = ebbgpio_queue_init(&devQueue, EVENT_FIFO_SIZE, 1);
+   if (result) goto err_boot;
+   result = ebbgpio_capture_init();
+   if (result) goto err_queue;
+   result = ebbgpio_queue_init(&nlQueue, EVENT_FIFO_SIZE, 1);
+   if (result) goto err_capture;
+   result = genl_register_family(&ebbgpio_genl_family);   // Multicast events and config over netlink
+   if (result) goto err_nlqueue;
+   ebbgpio_arb_init();                      // The defaults become the lowest priority request
+   ebbgpio_load_blob();                     // Configure everything in one pass before the LEDs light up
+   ebbgpio_boot_handover();                 // Built in: the boot pattern carries on as a request
    // Going to set up the LED. It is a GPIO in output mode and will be on by default
 
    gpio_request(gpioLedRED, "sysfs");          	// gpioLED is hardcoded to 49, request it
@@ -82,33 +2858,98 @@ static int __init ebbgpio_init(void){
    gpio_export(gpioLedRED, false);             	// Causes gpio49 to appear in /sys/class/gpio
 			                    	// the bool argument prevents the direction from being changed
    gpio_export(gpioLedGREEN,false);
+   printk(KERN_INFO "GPIO_TEST: LEDs driven %llu ms after boot\n", div_u64(ktime_get_boottime_ns(), NSEC_PER_MSEC));
    gpio_request(gpioButton, "sysfs");       // Set up the gpioButton
    gpio_direction_input(gpioButton);        // Set the button GPIO to be an input
-   gpio_set_debounce(gpioButton, 200);      // Debounce the button with a delay of 200ms
+   if (!touchSense) gpio_set_debounce(gpioButton, 200);   // Debounce the button with a delay of 200ms
    gpio_export(gpioButton, false);          // Causes gpio115 to appear in /sys/class/gpio
 			                    // the bool argument prevents the direction from being changed
    // Perform a quick test to see that the button is working as expected on LKM load
    printk(KERN_INFO "GPIO_TEST: The button state is currently: %d\n", gpio_get_value(gpioButton));
 
-   // GPIO numbers and IRQ numbers are not the same! This function performs the mapping for us
-   irqNumber = gpio_to_irq(gpioButton);
-   printk(KERN_INFO "GPIO_TEST: The button is mapped to IRQ: %d\n", irqNumber);
+   if (touchSense) result = ebbgpio_touch_init();   // The button line is a touch pad, scanned instead of an edge IRQ
+   else {
+      // GPIO numbers and IRQ numbers are not the same! This function performs the mapping for us
+      irqNumber = gpio_to_irq(gpioButton);
+      printk(KERN_INFO "GPIO_TEST: The button is mapped to IRQ: %d\n", irqNumber);
+
+      // This next call requests an interrupt line
+      result = request_irq(irqNumber,             // The interrupt number requested
+                           (irq_handler_t) ebbgpio_irq_handler, // The pointer to the handler function below
+                           IRQF_TRIGGER_RISING,   // Interrupt on rising edge (button press, not release)
+                           "ebb_gpio_handler",    // Used in /proc/interrupts to identify the owner
+                           NULL);                 // The *dev_id for shared interrupt lines, NULL is okay
+
+      printk(KERN_INFO "GPIO_TEST: The interrupt request result is: %d\n", result);
+   }
+   if (result) goto err_gpio;
 
-   // This next call requests an interrupt line
-   result = request_irq(irqNumber,             // The interrupt number requested
-                        (irq_handler_t) ebbgpio_irq_handler, // The pointer to the handler function below
-                        IRQF_TRIGGER_RISING,   // Interrupt on rising edge (button press, not release)
-                        "ebb_gpio_handler",    // Used in /proc/interrupts to identify the owner
-                        NULL);                 // The *dev_id for shared interrupt lines, NULL is okay
+   result = misc_register(&ebbgpio_misc);     // Control commands and events through /dev/ebbgpio
+   if (result){
+      printk(KERN_ALERT "GPIO_TEST: failed to register /dev/ebbgpio: %d\n", result);
+      goto err_irq;
+   }
 
-   printk(KERN_INFO "GPIO_TEST: The interrupt request result is: %d\n", result);
+   ebbgpio_pwm_init();                        // Needs the misc device, the lookups are bound to it
+   result = ebbgpio_strip_init();
+   if (result){
+      printk(KERN_ALERT "GPIO_TEST: failed to set up the WS2812 strip: %d\n", result);
+      goto err_misc;
+   }
+   result = ebbgpio_vlc_init();
+   if (result){
+      printk(KERN_ALERT "GPIO_TEST: failed to set up the optical link: %d\n", result);
+      goto err_strip;
+   }
+   result = ebbgpio_sonar_init();
+   if (result){
+      printk(KERN_ALERT "GPIO_TEST: failed to set up the ultrasonic sensors: %d\n", result);
+      goto err_vlc;
+   }
 
    task = kthread_run(kThread_run, NULL, "LED_thread");  // Start the LED flashing thread
    if(IS_ERR(task)){                                     // Kthread name is LED_flash_thread
       printk(KERN_ALERT "EBB LED: failed to create the task\n");
-      return PTR_ERR(task);
+      result = PTR_ERR(task);
+      goto err_sonar;
       }
  return result;
+
+err_sonar:
+   ebbgpio_sonar_exit();
+err_vlc:
+   ebbgpio_vlc_exit();
+err_strip:
+   ebbgpio_strip_exit();
+err_misc:
+   ebbgpio_pwm_exit();
+   misc_deregister(&ebbgpio_misc);
+   ebbgpio_pattern_exit();
+   mutex_lock(&captureLock);
+   ebbgpio_capture_stop();                  // An early opener may have started one, it samples the GPIOs and captureBuf
+   mutex_unlock(&captureLock);
+err_irq:
+   if (touchSense) ebbgpio_touch_exit();
+   else free_irq(irqNumber, NULL);
+err_gpio:
+   gpio_unexport(gpioButton);
+   gpio_unexport(gpioLedRED);
+   gpio_unexport(gpioLedGREEN);
+   gpio_free(gpioButton);
+   gpio_free(gpioLedRED);
+   gpio_free(gpioLedGREEN);
+   ebbgpio_arb_exit();
+   genl_unregister_family(&ebbgpio_genl_family);
+   cancel_work_sync(&nlWork);
+err_nlqueue:
+   kfifo_free(&nlQueue.fifo);
+err_capture:
+   vfree(captureBuf);
+err_queue:
+   kfifo_free(&devQueue.fifo);
+err_boot:
+   ebbgpio_boot_stop();                     // Still up if the driver failed before the handover
+   return result;
 }
 
 /** @brief The LKM cleanup function
@@ -117,18 +2958,35 @@ static int __init ebbgpio_init(void){
  *  GPIOs and display cleanup messages.
  */
 static void __exit ebbgpio_exit(void){
+   misc_deregister(&ebbgpio_misc);          // No new opens or commands from here on
+   genl_unregister_family(&ebbgpio_genl_family);	// Nor netlink commands, SET_CONFIG kicks the thread
+   cancel_work_sync(&nlWork);               // Without listeners nothing queues it again
+   if (touchSense) ebbgpio_touch_exit();    // Stop the button input first, it wakes the thread
+   else free_irq(irqNumber, NULL);          // Free the IRQ number first, the handler wakes the thread
+   ebbgpio_arb_exit();                      // The expiry and idle timers wake it too
    kthread_stop(task);
+   WRITE_ONCE(task, NULL);                  // ebbgpio_kick_thread() ignores it from here on
+   ebbgpio_pattern_exit();                  // Neither the thread nor a command can use them any more
+   ebbgpio_pwm_exit();
+   ebbgpio_strip_exit();
+   ebbgpio_vlc_exit();
+   ebbgpio_sonar_exit();
+   mutex_lock(&captureLock);
+   ebbgpio_capture_stop();                  // The sampler reads the GPIOs freed below
+   mutex_unlock(&captureLock);
    printk(KERN_INFO "GPIO_TEST: The button state is currently: %d\n", gpio_get_value(gpioButton));
-   printk(KERN_INFO "GPIO_TEST: The button was pressed %d times\n", numberPresses);
+   printk(KERN_INFO "GPIO_TEST: The button was pressed %d times\n", ebb.numberPresses);
    gpio_set_value(gpioLedRED, 0);              // Turn the LED off, makes it clear the device was unloaded
    gpio_set_value(gpioLedGREEN,0);
    gpio_unexport(gpioLedRED);                  // Unexport the LED GPIO
    gpio_unexport(gpioLedGREEN);
-   free_irq(irqNumber, NULL);               // Free the IRQ number, no *dev_id required in this case
    gpio_unexport(gpioButton);               // Unexport the Button GPIO
    gpio_free(gpioLedRED);                      // Free the LED GPIO
    gpio_free(gpioLedGREEN);
    gpio_free(gpioButton);                   // Free the Button GPIO
+   kfifo_free(&nlQueue.fifo);
+   vfree(captureBuf);
+   kfifo_free(&devQueue.fifo);              // Line requests hold a module reference, so none are left
    printk(KERN_INFO "GPIO_TEST: Goodbye from the LKM!\n");
 }
 
@@ -146,16 +3004,8 @@ static irq_handler_t ebbgpio_irq_handler(unsigned int irq, void *dev_id, struct
    //gpio_set_value(gpioLedRED,(!gpio_get_value(gpioLedRED)));
    //gpio_set_value(gpioLedGREEN,(!gpio_get_value(gpioLedGREEN)));                 // Invert the LED state on each button press
    //printk(KERN_INFO "GPIO_TEST: Interrupt! (button state is %d)\n", gpio_get_value(gpioButton));
-   printk(KERN_INFO "Button pressed count is %d\n", numberPresses);
-   if(mode == FLASH)
-    {
-      mode = ON;
-    }
-   else
-    {
-      mode = FLASH;
-    }
-   numberPresses++;                         // Global counter, will be outputted when the module is unloaded
+   printk(KERN_INFO "Button pressed count is %d\n", ebb.numberPresses);
+   ebbgpio_button_action();
    return (irq_handler_t) IRQ_HANDLED;      // Announce that the IRQ has been handled correctly
 }
 
@@ -164,3 +3014,7 @@ static irq_handler_t ebbgpio_irq_handler(unsigned int irq, void *dev_id, struct
 /// and the cleanup function (as above).
 module_init(ebbgpio_init);
 module_exit(ebbgpio_exit);
+
+#ifdef EBBGPIO_KUNIT
+#include "ebbgpio_kunit.c"                  // Unit tests of the static helpers, see "make KUNIT=1"
+#endif
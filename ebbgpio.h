@@ -0,0 +1,412 @@
+/**
+ * @file   ebbgpio.h
+ * @author Sonu Verma
+ * @brief  User-space interface of the BBB LED/button driver (/dev/ebbgpio)
+ *
+ *  This header is shared between the kernel module and user-space programs, so it only
+ *  uses the fixed-size __u types from <linux/types.h>.
+*/
+
+#ifndef EBBGPIO_H
+#define EBBGPIO_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/// Line numbers used in events and configuration (not GPIO numbers)
+enum ebbgpio_line {
+   EBBGPIO_LINE_RED    = 0,
+   EBBGPIO_LINE_GREEN  = 1,
+   EBBGPIO_LINE_BUTTON = 2,
+   EBBGPIO_NUM_LINES
+};
+#define EBBGPIO_MAX_LINES         16          ///< Room for lines in fixed-size arrays of this interface
+#define EBBGPIO_LINE_ANY          0xffffffffU ///< Line of records not tied to one line
+
+/// LED modes, same values as the driver's enum modes
+enum ebbgpio_mode {
+   EBBGPIO_MODE_OFF   = 0,
+   EBBGPIO_MODE_ON    = 1,
+   EBBGPIO_MODE_FLASH = 2
+};
+
+/// Event types reported through read() on the device
+enum ebbgpio_event_type {
+   EBBGPIO_EVENT_PRESS   = 1,                 ///< Rising edge on the button line, or a touch of pad 0
+   EBBGPIO_EVENT_GAP     = 2,                 ///< value events were dropped here because the queue was full
+   EBBGPIO_EVENT_TOUCH   = 3,                 ///< Touch pad value was touched, reported on the button line
+   EBBGPIO_EVENT_RELEASE = 4,                 ///< Touch pad value was released
+   EBBGPIO_EVENT_SLO_ALARM = 5,               ///< A latency p99 stayed above its SLO, value is the p99 in us
+   EBBGPIO_EVENT_SLO_CLEAR = 6                ///< The latency is back within its SLO, value is the p99 in us
+};
+
+/// One event as returned by read(); reads always return whole events
+struct ebbgpio_event {
+   __u64 timestamp_ns;                        ///< ktime_get_ns() when the edge was seen
+   __u32 line;                                ///< enum ebbgpio_line, EBBGPIO_LINE_ANY for gap records
+   __u32 type;                                ///< enum ebbgpio_event_type
+   __u32 seqno;                               ///< Per line, increases by one with every event; 0 in gap records
+   __u32 value;                               ///< Depends on type
+};
+
+/// Counter snapshot for consumers that restart, see EBBGPIO_IOC_RESYNC
+struct ebbgpio_resync {
+   __u32 flags;                               ///< In: EBBGPIO_RESYNC_FLUSH discards the queued events
+   __u32 seqno[EBBGPIO_MAX_LINES];            ///< Out: last sequence number given out per line
+   __u32 reserved;
+   __u64 presses;                             ///< Out: button presses so far
+   __u64 dropped;                             ///< Out: events this queue has dropped so far
+   __u64 timestamp_ns;                        ///< Out: when the snapshot was taken
+};
+#define EBBGPIO_RESYNC_FLUSH      (1U << 0)
+
+/// LED configuration
+struct ebbgpio_config {
+   __u32 mode;                                ///< enum ebbgpio_mode
+   __u32 blink_period_ms;                     ///< Blink period in ms, must be non-zero
+   __u32 slack_us[2];                         ///< Toggle tolerance in us for RED and GREEN, 0 for exact timing
+};
+
+/// Driver counters
+struct ebbgpio_stats {
+   __u64 presses;                             ///< Number of button presses
+   __u64 events_dropped;                      ///< Events lost because the queue was full
+   __u64 blink_wakeups;                       ///< Wake ups of the LED thread, sample twice for a rate
+   __u64 strip_frames;                        ///< WS2812 frames sent
+   __u64 strip_frame_ns;                      ///< Wall time the last WS2812 frame took, waiting for SPI included
+   __u64 vlc_tx_frames;                       ///< Optical link frames sent
+   __u64 vlc_rx_frames;                       ///< Optical link frames received with a good CRC
+   __u64 vlc_rx_errors;                       ///< Optical link frames lost to coding or CRC errors
+   __u64 vlc_rx_dropped;                      ///< Received bytes dropped because /dev/ebbvlc was not read
+   __u64 idle_entries;                        ///< Times the LEDs dropped to the idle pattern
+   __u64 strip_frame_ns_total;                ///< Wall time of all WS2812 frames
+   __u64 strip_cpu_ns;                        ///< CPU time of the last WS2812 frame, encoding or bit-banging
+   __u64 strip_cpu_ns_total;                  ///< CPU time of all WS2812 frames
+   __u32 instance_bytes;                      ///< Size of the per-instance LED state
+   __u32 patterns;                            ///< Patterns in the shared library
+   __u64 pattern_bytes;                       ///< Memory of the shared library, paid once for all instances
+};
+
+/// What the LED thread does after it woke too late for a toggle, see the blinkOverrun parameter
+enum ebbgpio_overrun {
+   EBBGPIO_OVERRUN_SKIP = 0,                  ///< Drop the missed toggles and stay in phase
+   EBBGPIO_OVERRUN_CATCHUP,                   ///< Make up the missed toggles back to back
+   EBBGPIO_OVERRUN_DEGRADE,                   ///< Halve the blink rate until the deadlines are met again
+};
+
+#define EBBGPIO_LATE_BUCKETS      16          ///< Bucket 0 is under 1 us, bucket n covers [2^(n-1), 2^n) us
+
+/// Blink deadline accounting, see EBBGPIO_IOC_GET_TIMING
+struct ebbgpio_timing {
+   __u64 deadlines;                           ///< Timed toggles the LED thread woke up for
+   __u64 misses;                              ///< Of those, toggles later than slack plus blinkLateUs
+   __u64 skipped;                             ///< Toggles dropped by EBBGPIO_OVERRUN_SKIP
+   __u64 late_max_ns;                         ///< Worst lateness seen
+   __u64 late_total_ns;                       ///< Sum of the lateness of the misses
+   __u32 overrun;                             ///< enum ebbgpio_overrun in force
+   __u32 degrade_shift;                       ///< Current period multiplier is 1 << degrade_shift
+   __u64 late_hist[EBBGPIO_LATE_BUCKETS];     ///< Lateness of every timed toggle, log2 buckets
+};
+
+#define EBBGPIO_TOUCH_MAX_PADS    4           ///< The button line plus up to three extra pads
+
+/// Touch sensing state and cost, see EBBGPIO_IOC_GET_TOUCH
+struct ebbgpio_touch {
+   __u64 scans;                               ///< Scans of all pads so far, sample twice for the rate
+   __u64 scan_ns_total;                       ///< CPU time spent scanning
+   __u64 scan_ns_max;                         ///< Longest single scan
+   __u64 latency_ns;                          ///< Last touch: time since the pad was last seen untouched
+   __u32 scan_hz;                             ///< Configured scan rate
+   __u32 num_pads;
+   __u32 touched;                             ///< Bit n set while pad n is touched
+   __u32 reserved;
+   __u32 raw[EBBGPIO_TOUCH_MAX_PADS];         ///< Charge time of the last scan, in read loops
+   __u32 baseline[EBBGPIO_TOUCH_MAX_PADS];    ///< Untouched charge time, in 1/256 read loops
+};
+
+#define EBBGPIO_SONAR_MAX         4           ///< Ultrasonic sensors measured in turn
+
+/// Latest result of one ultrasonic sensor
+struct ebbgpio_sonar {
+   __u64 timestamp_ns;                        ///< When the echo ended, 0 before the first measurement
+   __u32 distance_mm;                         ///< Distance of the last good echo
+   __u32 echo_ns;                             ///< Echo pulse width it was computed from
+   __u64 measurements;                        ///< Good echoes so far, sample twice for the rate
+   __u64 timeouts;                            ///< Slots that ended without a complete echo in range
+};
+
+/// Ultrasonic ranging state and timing error, see EBBGPIO_IOC_GET_RANGE
+struct ebbgpio_range {
+   __u32 num_sensors;
+   __u32 slot_ms;                             ///< Each sensor gets the bus alone for this long, in turn
+   __u64 triggers;                            ///< Trigger pulses fired
+   __u64 trigger_late_ns_total;               ///< Sum of the delays of the triggers behind their slot
+   __u64 trigger_late_ns_max;
+   __u64 pulse_ns_max;                        ///< Longest trigger pulse, nominally 10 us
+   __u64 stray_edges;                         ///< Echo edges outside their sensor's slot, i.e. crosstalk
+   struct ebbgpio_sonar sensor[EBBGPIO_SONAR_MAX];
+};
+
+/** @brief Latencies tracked by the driver, see EBBGPIO_IOC_GET_LATENCY
+ *  SLO events for EBBGPIO_LAT_EDGE are reported on the button line, those for
+ *  EBBGPIO_LAT_TIMER on the RED line.
+ */
+enum ebbgpio_latency_metric {
+   EBBGPIO_LAT_EDGE  = 0,                     ///< Button edge to the LEDs showing the new request
+   EBBGPIO_LAT_TIMER = 1,                     ///< Lateness of the blink toggles
+   EBBGPIO_LAT_NUM
+};
+
+/// Streaming quantiles of one latency, within 12.5% of the true value
+struct ebbgpio_quantiles {
+   __u64 count;                               ///< Samples so far
+   __u64 p50_ns;
+   __u64 p99_ns;
+   __u64 p999_ns;
+   __u32 slo_us;                              ///< p99 objective, 0 when not monitored
+   __u32 alarmed;                             ///< 1 between an SLO_ALARM and the following SLO_CLEAR
+   __u64 alarms;                              ///< SLO_ALARM events sent
+};
+
+struct ebbgpio_latency {
+   struct ebbgpio_quantiles metric[EBBGPIO_LAT_NUM];
+};
+
+#define EBBGPIO_PATTERN_MAX_FRAMES 256
+
+/// One step of a pattern
+struct ebbgpio_frame {
+   __u16 duration_ms;                         ///< At least 1
+   __u8 leds;                                 ///< Bit (1 << enum ebbgpio_line) lights RED or GREEN
+   __u8 reserved;
+};
+
+/** @brief Add, replace or delete a pattern in the shared library, see EBBGPIO_IOC_PATTERN_LOAD
+ *  Instances already playing a replaced or deleted pattern keep playing their copy until they
+ *  select another one. Adding fails with ENOSPC once the library holds the patternMax module
+ *  parameter's number of patterns.
+ */
+struct ebbgpio_pattern {
+   __u32 id;                                  ///< Non-zero
+   __u32 num_frames;                          ///< 0 deletes the pattern
+   __u64 frames;                              ///< User pointer to struct ebbgpio_frame[num_frames]
+};
+
+/** @brief Select what FLASH shows, see EBBGPIO_IOC_PATTERN_PLAY
+ *  The position in the pattern follows CLOCK_MONOTONIC plus phase_ms, so instances playing the
+ *  same pattern with the same phase stay in step.
+ */
+struct ebbgpio_pattern_play {
+   __u32 id;                                  ///< Pattern id, 0 for the plain blink
+   __u32 phase_ms;
+};
+
+/// Apply a configuration and fetch queued events in one call
+struct ebbgpio_xfer {
+   __u32 flags;                               ///< EBBGPIO_XFER_* flags
+   __u32 max_events;                          ///< Capacity of the events array
+   struct ebbgpio_config config;              ///< Applied first when EBBGPIO_XFER_SET_CONFIG is set
+   __u64 events;                              ///< User pointer to struct ebbgpio_event[max_events]
+};
+#define EBBGPIO_XFER_SET_CONFIG   (1U << 0)
+
+/// Request a file descriptor bound to a subset of lines, see EBBGPIO_IOC_LINE_REQUEST
+struct ebbgpio_line_request {
+   __u64 lines;                               ///< Bitmask of (1 << enum ebbgpio_line), at least one line
+   __u32 event_types;                         ///< Bitmask of (1 << enum ebbgpio_event_type), 0 for all types
+   __u32 wakeup_events;                       ///< Wake readers once this many events are queued, 0 for every event
+   __u32 queue_size;                          ///< Events buffered for this fd, 0 for the default
+   __s32 fd;                                  ///< Returned: the new line request file descriptor
+};
+
+/// Start or stop logic-analyzer capture, see EBBGPIO_IOC_CAPTURE
+struct ebbgpio_capture {
+   __u64 lines;                               ///< Bitmask of (1 << enum ebbgpio_line), at most 8 lines
+   __u32 rate_hz;                             ///< Sample rate, 0 stops a running capture
+   __u32 reserved;                            ///< Must be zero
+};
+
+#define EBBGPIO_CAPTURE_MAGIC     0x45424243  ///< "EBBC"
+#define EBBGPIO_CAPTURE_VERSION   1
+#define EBBGPIO_CAPTURE_MAX_LINES 8
+
+/**
+ *  Start of the capture buffer, mapped read-only with mmap() on /dev/ebbgpio. It is followed
+ *  by num_records __u32 records used as a ring: record n lives at index n % num_records.
+ *  Each record holds the line levels in bits 0-7 (bit i is the i-th line set in lines, counting
+ *  from line 0) and in bits 8-31 how many consecutive samples had those levels. The newest
+ *  record, head - 1, keeps growing while the lines stay idle. head is a native word so that 32-bit
+ *  kernels can publish it atomically; it wraps, and EBBGPIO_CAPTURE_WRAPPED tells that all
+ *  num_records records are valid, the oldest at head - num_records.
+ */
+struct ebbgpio_capture_header {
+   __u32 magic;                               ///< EBBGPIO_CAPTURE_MAGIC
+   __u32 version;                             ///< EBBGPIO_CAPTURE_VERSION
+   __u64 lines;                               ///< Lines being sampled
+   __u32 rate_hz;                             ///< Sample rate
+   __u32 num_records;                         ///< Capacity of the record ring
+   __u32 head;                                ///< Records written since the capture started, modulo 2^32
+   __u32 flags;                               ///< EBBGPIO_CAPTURE_WRAPPED
+   __u64 samples;                             ///< Samples taken since the capture started
+   __u64 overruns;                            ///< Sample slots the sampler was too late for, held at the last level
+   __u64 start_ns;                            ///< ktime_get_ns() of the first sample
+   __u64 reserved;
+};
+#define EBBGPIO_CAPTURE_WRAPPED   0x1        ///< The ring has been filled at least once
+#define EBBGPIO_CAPTURE_LEVELS(r) ((r) & 0xff)
+#define EBBGPIO_CAPTURE_RUN(r)    ((r) >> 8)
+#define EBBGPIO_CAPTURE_RUN_MAX   0xffffffU
+
+/**
+ *  LED requests. Every client posts the mode it wants at a priority and the highest priority
+ *  request is shown; among equal priorities the lowest client id wins. The configuration set
+ *  with EBBGPIO_IOC_SET_CONFIG is the request of EBBGPIO_CLIENT_CONFIG.
+ */
+enum ebbgpio_client {
+   EBBGPIO_CLIENT_CONFIG    = 0,              ///< The configured mode, never expires
+   EBBGPIO_CLIENT_BUTTON    = 1,              ///< Toggled by the button
+   EBBGPIO_CLIENT_IDLE      = 2,              ///< Low-power pattern after a while without input
+   EBBGPIO_CLIENT_BOOT      = 3,              ///< Built-in driver only, the boot pattern until it expires
+   EBBGPIO_CLIENT_FIRST_APP = 4,              ///< First id free for applications and kernel users
+   EBBGPIO_MAX_CLIENTS      = 16
+};
+#define EBBGPIO_PRIO_CONFIG       0
+#define EBBGPIO_PRIO_IDLE         4
+#define EBBGPIO_PRIO_BOOT         6
+#define EBBGPIO_PRIO_BUTTON       8
+#define EBBGPIO_MAX_PRIORITY      31
+
+/// Post or withdraw a request, see EBBGPIO_IOC_POST_REQUEST
+struct ebbgpio_request {
+   __u32 client;                              ///< EBBGPIO_CLIENT_FIRST_APP to EBBGPIO_MAX_CLIENTS - 1
+   __u32 priority;                            ///< 0 to EBBGPIO_MAX_PRIORITY, higher wins
+   __u32 mode;                                ///< enum ebbgpio_mode
+   __u32 blink_period_ms;                     ///< Must be non-zero
+   __u32 timeout_ms;                          ///< The request is withdrawn after this, 0 for never
+   __u32 flags;                               ///< EBBGPIO_REQUEST_CLEAR withdraws the client's request
+};
+#define EBBGPIO_REQUEST_CLEAR     (1U << 0)
+
+/// What the LEDs show right now, see EBBGPIO_IOC_GET_EFFECTIVE
+struct ebbgpio_effective {
+   __u32 client;                              ///< The winning client
+   __u32 priority;
+   __u32 mode;
+   __u32 blink_period_ms;
+   __u32 active_clients;                      ///< Bitmask of the clients with a request
+   __u32 reserved;
+};
+
+/// Update pixels of the WS2812 strip, see EBBGPIO_IOC_STRIP_FRAME
+struct ebbgpio_strip_frame {
+   __u64 rgb;                                 ///< User pointer to count R, G, B byte triples
+   __u32 offset;                              ///< First pixel to update
+   __u32 count;                               ///< Pixels to update
+};
+
+/**
+ *  Binary configuration blob, loaded with request_firmware() when the module initialises and
+ *  produced by "ebbgpioctl compile" from a text description. All fields are little-endian.
+ *  The header is followed by length bytes of records, each a struct ebbgpio_blob_record and
+ *  its payload padded to a multiple of 4 bytes. crc32 is the zlib CRC-32 of the records.
+ */
+struct ebbgpio_blob_header {
+   __le32 magic;                              ///< EBBGPIO_BLOB_MAGIC
+   __le16 version;                            ///< EBBGPIO_BLOB_VERSION
+   __le16 num_records;
+   __le32 length;                             ///< Bytes of records following the header
+   __le32 crc32;
+};
+
+struct ebbgpio_blob_record {
+   __le16 tag;                                ///< enum ebbgpio_blob_tag
+   __le16 length;                             ///< Payload bytes, without padding
+};
+
+/// Record types of a configuration blob and their payload
+enum ebbgpio_blob_tag {
+   EBBGPIO_BLOB_CONFIG  = 1,                  ///< struct ebbgpio_config
+   EBBGPIO_BLOB_PATTERN = 2,                  ///< struct ebbgpio_blob_pattern and its frames
+   EBBGPIO_BLOB_IDLE    = 3,                  ///< struct ebbgpio_blob_idle
+   EBBGPIO_BLOB_REQUEST = 4                   ///< struct ebbgpio_request, flags must be 0
+};
+
+/// A pattern for the shared library, followed by 1 to EBBGPIO_PATTERN_MAX_FRAMES struct ebbgpio_frame
+struct ebbgpio_blob_pattern {
+   __le32 id;                                 ///< Non-zero
+   __le32 flags;                              ///< EBBGPIO_BLOB_PATTERN_PLAY
+};
+#define EBBGPIO_BLOB_PATTERN_PLAY (1U << 0)   ///< Also show it in FLASH, as EBBGPIO_IOC_PATTERN_PLAY with phase 0
+
+/// The idle settings, see the idleTimeoutS, idleMode and idleBlinkPeriod module parameters
+struct ebbgpio_blob_idle {
+   __le32 timeout_s;                          ///< Seconds without input before going idle, 0 never
+   __le32 mode;                               ///< enum ebbgpio_mode while idle
+   __le32 blink_period_ms;                    ///< Blink period of an idle FLASH, must be non-zero
+};
+
+#define EBBGPIO_BLOB_MAGIC        0x45424246  ///< "EBBF"
+#define EBBGPIO_BLOB_VERSION      1
+
+/**
+ *  Generic netlink family. Listeners of the "events" multicast group receive EBBGPIO_CMD_EVENTS
+ *  messages carrying one or more EBBGPIO_ATTR_EVENT attributes, and EBBGPIO_CMD_CONFIG_CHANGED
+ *  messages after every configuration change. Attributes carry the same structures as the ioctls.
+ */
+#define EBBGPIO_GENL_NAME         "ebbgpio"
+#define EBBGPIO_GENL_VERSION      1
+#define EBBGPIO_GENL_MCGRP_EVENTS "events"
+
+enum ebbgpio_genl_cmd {
+   EBBGPIO_CMD_UNSPEC,
+   EBBGPIO_CMD_GET_CONFIG,                    ///< Reply carries EBBGPIO_ATTR_CONFIG
+   EBBGPIO_CMD_SET_CONFIG,                    ///< Takes EBBGPIO_ATTR_CONFIG, needs CAP_NET_ADMIN
+   EBBGPIO_CMD_GET_STATS,                     ///< Reply carries EBBGPIO_ATTR_STATS
+   EBBGPIO_CMD_EVENTS,                        ///< Multicast, a batch of EBBGPIO_ATTR_EVENT
+   EBBGPIO_CMD_CONFIG_CHANGED,                ///< Multicast, carries EBBGPIO_ATTR_CONFIG
+};
+
+enum ebbgpio_genl_attr {
+   EBBGPIO_ATTR_UNSPEC,
+   EBBGPIO_ATTR_CONFIG,                       ///< struct ebbgpio_config
+   EBBGPIO_ATTR_STATS,                        ///< struct ebbgpio_stats
+   EBBGPIO_ATTR_EVENT,                        ///< struct ebbgpio_event
+   __EBBGPIO_ATTR_MAX
+};
+#define EBBGPIO_ATTR_MAX          (__EBBGPIO_ATTR_MAX - 1)
+
+/**
+ *  Payload of an IORING_OP_URING_CMD submission. The command op is one of the ioctl
+ *  numbers below and addr points to the same argument the ioctl would take. The 16 bytes
+ *  fit in the command area of a normal (non SQE128) submission entry.
+ */
+struct ebbgpio_uring_cmd {
+   __u64 addr;                                ///< User pointer to the ioctl argument
+   __u64 reserved;                            ///< Must be zero
+};
+
+#define EBBGPIO_IOC_MAGIC        'E'
+#define EBBGPIO_IOC_GET_CONFIG   _IOR(EBBGPIO_IOC_MAGIC, 1, struct ebbgpio_config)
+#define EBBGPIO_IOC_SET_CONFIG   _IOW(EBBGPIO_IOC_MAGIC, 2, struct ebbgpio_config)
+#define EBBGPIO_IOC_GET_STATS    _IOR(EBBGPIO_IOC_MAGIC, 3, struct ebbgpio_stats)
+#define EBBGPIO_IOC_XFER         _IOWR(EBBGPIO_IOC_MAGIC, 4, struct ebbgpio_xfer)
+#define EBBGPIO_IOC_LINE_REQUEST _IOWR(EBBGPIO_IOC_MAGIC, 5, struct ebbgpio_line_request)
+#define EBBGPIO_IOC_CAPTURE      _IOW(EBBGPIO_IOC_MAGIC, 6, struct ebbgpio_capture)
+#define EBBGPIO_IOC_POST_REQUEST _IOW(EBBGPIO_IOC_MAGIC, 7, struct ebbgpio_request)
+#define EBBGPIO_IOC_GET_EFFECTIVE _IOR(EBBGPIO_IOC_MAGIC, 8, struct ebbgpio_effective)
+#define EBBGPIO_IOC_STRIP_FRAME  _IOW(EBBGPIO_IOC_MAGIC, 9, struct ebbgpio_strip_frame)
+#define EBBGPIO_IOC_RESYNC       _IOWR(EBBGPIO_IOC_MAGIC, 10, struct ebbgpio_resync)
+#define EBBGPIO_IOC_GET_TIMING   _IOR(EBBGPIO_IOC_MAGIC, 11, struct ebbgpio_timing)
+#define EBBGPIO_IOC_GET_TOUCH    _IOR(EBBGPIO_IOC_MAGIC, 12, struct ebbgpio_touch)
+#define EBBGPIO_IOC_GET_RANGE    _IOR(EBBGPIO_IOC_MAGIC, 13, struct ebbgpio_range)
+#define EBBGPIO_IOC_GET_LATENCY  _IOR(EBBGPIO_IOC_MAGIC, 14, struct ebbgpio_latency)
+#define EBBGPIO_IOC_PATTERN_LOAD _IOW(EBBGPIO_IOC_MAGIC, 15, struct ebbgpio_pattern)
+#define EBBGPIO_IOC_PATTERN_PLAY _IOW(EBBGPIO_IOC_MAGIC, 16, struct ebbgpio_pattern_play)
+
+#ifdef __KERNEL__
+/// For kernel users of the LED arbitration, see BeagleBone_LED-Button.c
+int ebbgpio_post_request(unsigned int client, unsigned int priority, __u32 mode, unsigned int period_ms, unsigned int timeout_ms);
+int ebbgpio_clear_request(unsigned int client);
+#endif
+
+#endif /* EBBGPIO_H */
@@ -0,0 +1,73 @@
+/**
+ * @file   ebbgpio_instance.h
+ * @author Sonu Verma
+ * @brief  Per-instance state of the BBB LED/button driver
+ *
+ *  Private to the driver, this is not part of the user-space interface. It is a header of its
+ *  own so that "ebbgpioctl bench-layout" times this very layout: the tool defines the handful
+ *  of kernel types used here and includes it.
+*/
+
+#ifndef EBBGPIO_INSTANCE_H
+#define EBBGPIO_INSTANCE_H
+
+#include "ebbgpio.h"
+
+enum modes {OFF, ON, FLASH};				///< Same values as enum ebbgpio_mode
+struct ebb_pattern;
+
+#define SKETCH_SUB_BITS				3		///< 8 buckets per power of two, within 12.5% of the value
+#define SKETCH_BUCKETS				256		///< Covers 0 to 2^34 ns (about 17 s), beyond lands in the top bucket
+#define SKETCH_DECAY				(1U << 30)	///< Counts are halved at this total, recent samples weigh more
+
+/// Log-linear histogram of latencies in ns, fixed size and O(1) to update
+struct ebb_sketch {
+   u32 count[SKETCH_BUCKETS];
+   u32 total;
+};
+
+/// One tracked latency: the long run sketch, and the current SLO window
+struct ebb_latency {
+   struct ebb_sketch all, window;
+   u64 windowStart;				///< ktime_get_ns() when the SLO window opened
+   u64 samples;
+   unsigned int streak;				///< Windows in a row with the p99 above the SLO
+   bool alarmed;
+   unsigned long alarms;
+};
+
+/** @brief The state of the LED/button instance, grouped by the context that writes it
+ *  The button IRQ and the LED thread usually run on different CPUs. Each group starts a cache
+ *  line of its own, so a press never steals the line the LED thread updates on every toggle, and
+ *  the settings both of them read are only dirtied when a request or the configuration changes.
+ */
+struct ebb_instance {
+   struct {					// Written by the button IRQ handler
+      unsigned int numberPresses;		///< For information, store the number of button presses
+      unsigned long lastInput;			///< jiffies of the latest press, checked by idleTimer
+      unsigned long edgeNs;			///< ktime_get_ns() | 1 of a press not yet shown, a native word for xchg()
+   } ____cacheline_aligned_in_smp;
+   struct {					// Written by the LED thread only
+      bool ledOn;
+      unsigned int blinkDegradeShift, blinkOnTime;
+      unsigned long blinkWakeups;		///< Times the LED thread woke up, for power accounting
+      unsigned long blinkDeadlines, blinkMisses, blinkSkipped;
+      u64 blinkLateMaxNs, blinkLateTotalNs;
+      unsigned long blinkLateHist[EBBGPIO_LATE_BUCKETS];
+      struct ebb_latency lat[EBBGPIO_LAT_NUM];	///< Indexed by enum ebbgpio_latency_metric
+      u32 patternCursor;			///< Next frame of the pattern to show
+   } ____cacheline_aligned_in_smp;
+   struct {					// Read mostly, written on a request or configuration change
+      atomic_t ledGen;				///< Bumped on every change of what the LEDs show
+      enum modes mode;				///< Default mode is flashing, then the winning request's
+      unsigned int blinkPeriod;			///< The blink period in ms
+      unsigned int blinkSlackUs[2];		///< Per LED tolerance on each toggle, in us (RED, GREEN)
+      unsigned int blinkOverrun;		///< enum ebbgpio_overrun
+      unsigned int blinkLateUs;			///< Lateness beyond the slack that counts as a miss
+      unsigned long idleActive;			///< Bit 0 set while the idle request is posted
+      struct ebb_pattern __rcu *pattern;	///< Shown instead of the plain blink in FLASH, holds a reference
+      u32 patternPhaseMs;			///< Offset of this instance into the pattern
+   } ____cacheline_aligned_in_smp;
+};
+
+#endif /* EBBGPIO_INSTANCE_H */
@@ -0,0 +1,357 @@
+/**
+ * @file   ebbgpio_kunit.c
+ * @author Sonu Verma
+ * @brief  KUnit tests of the BBB LED/button driver's internal helpers
+ *
+ *  Included at the end of BeagleBone_LED-Button.c when built with "make KUNIT=1", so the tests
+ *  reach the static functions directly. Needs a kernel with CONFIG_KUNIT; the suites run when
+ *  the module is loaded and report through the kernel log (or kunit.py with --raw_output).
+*/
+
+#include <kunit/test.h>
+#include <kunit/device.h>
+#include <linux/prandom.h>
+#include <linux/mman.h>
+
+/// What the fake PWM channel was last programmed with
+struct ebbgpio_fake_pwm {
+   struct pwm_state last;
+   unsigned int applies;
+   int ret;                                     ///< Returned by apply, to test the failure path
+};
+
+/// A one channel pwm_chip on a KUnit device, handed to ebbgpio_pwm_apply() as the RED LED
+struct ebbgpio_pwm_test {
+   struct pwm_chip *chip;
+   struct pwm_lookup lookup;
+   struct pwm_device *pwm;
+   struct pwm_device *saved[2];                 ///< ledPwm[] of the running driver
+   unsigned int savedDuty;
+   bool parked;                                 ///< The LED thread is held while ledPwm[] is swapped
+};
+
+static int ebbgpio_fake_pwm_apply(struct pwm_chip *chip, struct pwm_device *pwm, const struct pwm_state *state){
+   struct ebbgpio_fake_pwm *f = pwmchip_get_drvdata(chip);
+
+   f->applies++;
+   if (f->ret) return f->ret;
+   f->last = *state;
+   return 0;
+}
+
+static const struct pwm_ops ebbgpio_fake_pwm_ops = {
+   .apply = ebbgpio_fake_pwm_apply,
+};
+
+static struct ebbgpio_fake_pwm *ebbgpio_fake_pwm(struct kunit *test){
+   struct ebbgpio_pwm_test *t = test->priv;
+
+   return pwmchip_get_drvdata(t->chip);
+}
+
+static int ebbgpio_pwm_test_init(struct kunit *test){
+   struct ebbgpio_pwm_test *t;
+   struct device *dev;
+
+   t = kunit_kzalloc(test, sizeof(*t), GFP_KERNEL);
+   KUNIT_ASSERT_NOT_NULL(test, t);
+   dev = kunit_device_register(test, "ebbgpio-fake-pwm");
+   KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+   t->chip = pwmchip_alloc(dev, 1, sizeof(struct ebbgpio_fake_pwm));
+   KUNIT_ASSERT_NOT_ERR_OR_NULL(test, t->chip);
+   t->chip->ops = &ebbgpio_fake_pwm_ops;
+   KUNIT_ASSERT_EQ(test, pwmchip_add(t->chip), 0);
+   t->lookup = (struct pwm_lookup)PWM_LOOKUP(dev_name(dev), 0, dev_name(dev), "red",
+                                             NSEC_PER_MSEC, PWM_POLARITY_NORMAL);
+   pwm_add_table(&t->lookup, 1);
+   t->pwm = pwm_get(dev, "red");
+   KUNIT_ASSERT_NOT_ERR_OR_NULL(test, t->pwm);
+   // The LED thread reads ledPwm[] and ledDutyPercent on every wake up, keep it parked meanwhile
+   kthread_park(task);
+   t->parked = true;
+   t->saved[EBBGPIO_LINE_RED] = ledPwm[EBBGPIO_LINE_RED];
+   t->saved[EBBGPIO_LINE_GREEN] = ledPwm[EBBGPIO_LINE_GREEN];
+   t->savedDuty = ledDutyPercent;
+   ledPwm[EBBGPIO_LINE_RED] = t->pwm;
+   ledPwm[EBBGPIO_LINE_GREEN] = NULL;
+   test->priv = t;
+   return 0;
+}
+
+static void ebbgpio_pwm_test_exit(struct kunit *test){
+   struct ebbgpio_pwm_test *t = test->priv;
+
+   if (!t) return;
+   if (!t->parked) kthread_park(task);		// A test may have let the thread run
+   ledPwm[EBBGPIO_LINE_RED] = t->saved[EBBGPIO_LINE_RED];
+   ledPwm[EBBGPIO_LINE_GREEN] = t->saved[EBBGPIO_LINE_GREEN];
+   ledDutyPercent = t->savedDuty;
+   kthread_unpark(task);
+   pwm_put(t->pwm);
+   pwm_remove_table(&t->lookup, 1);
+   pwmchip_remove(t->chip);
+   pwmchip_put(t->chip);
+}
+
+/// FLASH is a 50% duty cycle whose on and off times match the software toggles (period / 3)
+static void ebbgpio_pwm_test_flash(struct kunit *test){
+   struct ebbgpio_fake_pwm *f = ebbgpio_fake_pwm(test);
+
+   ebbgpio_pwm_apply(FLASH, 900);
+   KUNIT_EXPECT_EQ(test, f->applies, 1U);
+   KUNIT_EXPECT_EQ(test, f->last.period, 600ULL * NSEC_PER_MSEC);
+   KUNIT_EXPECT_EQ(test, f->last.duty_cycle, 300ULL * NSEC_PER_MSEC);
+   KUNIT_EXPECT_TRUE(test, f->last.enabled);
+   KUNIT_EXPECT_EQ(test, f->last.polarity, PWM_POLARITY_NORMAL);
+
+   ebbgpio_pwm_apply(FLASH, 1);             // Below 3 ms the toggle interval is held at 1 ms
+   KUNIT_EXPECT_EQ(test, f->last.period, 2ULL * NSEC_PER_MSEC);
+   KUNIT_EXPECT_EQ(test, f->last.duty_cycle, (u64)NSEC_PER_MSEC);
+}
+
+/// ON dims with ledDutyPercent, clamped to 100%, and OFF disables the output
+static void ebbgpio_pwm_test_on_off(struct kunit *test){
+   struct ebbgpio_fake_pwm *f = ebbgpio_fake_pwm(test);
+
+   ledDutyPercent = 25;
+   ebbgpio_pwm_apply(ON, 1000);
+   KUNIT_EXPECT_EQ(test, f->last.period, (u64)NSEC_PER_MSEC);
+   KUNIT_EXPECT_EQ(test, f->last.duty_cycle, (u64)NSEC_PER_MSEC / 4);
+   KUNIT_EXPECT_TRUE(test, f->last.enabled);
+
+   ledDutyPercent = 250;
+   ebbgpio_pwm_apply(ON, 1000);
+   KUNIT_EXPECT_EQ(test, f->last.duty_cycle, (u64)NSEC_PER_MSEC);
+
+   ebbgpio_pwm_apply(OFF, 1000);
+   KUNIT_EXPECT_FALSE(test, f->last.enabled);
+   KUNIT_EXPECT_EQ(test, f->last.duty_cycle, 0ULL);
+}
+
+/// An LED without a channel stays on the software engine, and a failing channel is left as it was
+static void ebbgpio_pwm_test_fallback(struct kunit *test){
+   struct ebbgpio_fake_pwm *f = ebbgpio_fake_pwm(test);
+
+   KUNIT_EXPECT_FALSE(test, ebbgpio_led_sw(EBBGPIO_LINE_RED));
+   KUNIT_EXPECT_EQ(test, ebbgpio_led_sw(EBBGPIO_LINE_GREEN), vlcTxLed != EBBGPIO_LINE_GREEN);
+
+   ebbgpio_pwm_apply(FLASH, 300);
+   f->ret = -EIO;
+   ebbgpio_pwm_apply(OFF, 300);
+   KUNIT_EXPECT_EQ(test, f->applies, 2U);
+   KUNIT_EXPECT_TRUE(test, f->last.enabled);
+   KUNIT_EXPECT_EQ(test, f->last.period, 200ULL * NSEC_PER_MSEC);
+}
+
+/// Let the LED thread show the current request for ms, then park it again
+static unsigned long ebbgpio_pwm_test_run(struct kunit *test, unsigned int ms){
+   struct ebbgpio_pwm_test *t = test->priv;
+   unsigned long wakeups;
+
+   kthread_unpark(task);
+   t->parked = false;
+   ebbgpio_kick_thread();
+   msleep(20);					// Past the first wake up, which programs the outputs
+   wakeups = READ_ONCE(ebb.blinkWakeups);
+   msleep(ms);
+   wakeups = READ_ONCE(ebb.blinkWakeups) - wakeups;
+   kthread_park(task);
+   t->parked = true;
+   return wakeups;
+}
+
+/// A FLASH offloaded to the PWMs leaves the thread asleep, the software engine wakes it per toggle
+static void ebbgpio_pwm_test_wakeups(struct kunit *test){
+   struct ebbgpio_pwm_test *t = test->priv;
+   unsigned long pwm, sw;
+
+   ledPwm[EBBGPIO_LINE_GREEN] = t->pwm;		// Both LEDs on the fake channel
+   KUNIT_ASSERT_EQ(test, ebbgpio_post_request(EBBGPIO_CLIENT_FIRST_APP, EBBGPIO_MAX_PRIORITY,
+                                              EBBGPIO_MODE_FLASH, 30, 2000), 0);
+   pwm = ebbgpio_pwm_test_run(test, 300);
+   ledPwm[EBBGPIO_LINE_RED] = ledPwm[EBBGPIO_LINE_GREEN] = NULL;
+   sw = ebbgpio_pwm_test_run(test, 300);
+   ebbgpio_clear_request(EBBGPIO_CLIENT_FIRST_APP);
+   kunit_info(test, "FLASH 30 ms for 300 ms: %lu wake ups on the PWMs, %lu bit-banged\n", pwm, sw);
+   KUNIT_EXPECT_LE(test, pwm, 2UL);		// Only another client's change may wake it
+   KUNIT_EXPECT_GE(test, sw, 15UL);		// A toggle every 10 ms, with room for coalescing
+}
+
+static struct kunit_case ebbgpio_pwm_test_cases[] = {
+   KUNIT_CASE(ebbgpio_pwm_test_flash),
+   KUNIT_CASE(ebbgpio_pwm_test_on_off),
+   KUNIT_CASE(ebbgpio_pwm_test_fallback),
+   KUNIT_CASE(ebbgpio_pwm_test_wakeups),
+   {}
+};
+
+static struct kunit_suite ebbgpio_pwm_test_suite = {
+   .name = "ebbgpio-pwm",
+   .init = ebbgpio_pwm_test_init,
+   .exit = ebbgpio_pwm_test_exit,
+   .test_cases = ebbgpio_pwm_test_cases,
+};
+
+#define QUEUE_TEST_SIZE 8U				///< Small, so that every test overflows it
+
+/// What the consumer of a test queue has seen so far
+struct ebbgpio_queue_check {
+   u32 next;                                    ///< Sequence number expected next
+   unsigned long gaps;                          ///< Events reported missing by gap records
+};
+
+static int ebbgpio_queue_test_init(struct kunit *test){
+   struct ebbgpio_queue *q = kunit_kzalloc(test, sizeof(*q), GFP_KERNEL);
+
+   KUNIT_ASSERT_NOT_NULL(test, q);
+   KUNIT_ASSERT_EQ(test, ebbgpio_queue_init(q, QUEUE_TEST_SIZE, 1), 0);
+   test->priv = q;
+   return 0;
+}
+
+static void ebbgpio_queue_test_exit(struct kunit *test){
+   struct ebbgpio_queue *q = test->priv;
+
+   if (q) kfifo_free(&q->fifo);
+}
+
+/// Push an event carrying the producer's own sequence number
+static void ebbgpio_queue_test_push(struct ebbgpio_queue *q, u32 *seq){
+   struct ebbgpio_event ev = {
+      .timestamp_ns = ktime_get_ns(),
+      .line = EBBGPIO_LINE_BUTTON,
+      .type = EBBGPIO_EVENT_PRESS,
+      .seqno = ++*seq,
+   };
+
+   ebbgpio_queue_push(q, &ev);
+}
+
+/** @brief Fetch up to max records and check the stream
+ *  Every event must carry the next sequence number once the gap records before it are counted.
+ *  @return the number of records fetched
+ */
+static unsigned int ebbgpio_queue_test_drain(struct kunit *test, struct ebbgpio_queue *q,
+                                             struct ebbgpio_queue_check *c, unsigned int max){
+   struct ebbgpio_event buf[QUEUE_TEST_SIZE];
+   unsigned int n, i;
+
+   n = ebbgpio_queue_fetch(q, buf, min_t(unsigned int, max, QUEUE_TEST_SIZE));
+   for (i = 0; i < n; i++){
+      if (buf[i].type == EBBGPIO_EVENT_GAP){
+         KUNIT_EXPECT_EQ(test, buf[i].line, (u32)EBBGPIO_LINE_ANY);
+         KUNIT_EXPECT_GT(test, buf[i].value, 0U);
+         c->next += buf[i].value;
+         c->gaps += buf[i].value;
+      } else {
+         KUNIT_EXPECT_EQ(test, buf[i].seqno, c->next);
+         c->next = buf[i].seqno + 1;
+      }
+   }
+   return n;
+}
+
+/// Drain the queue and check that every event pushed was either read or reported missing
+static void ebbgpio_queue_test_settle(struct kunit *test, struct ebbgpio_queue *q,
+                                     struct ebbgpio_queue_check *c, u32 seq){
+   while (ebbgpio_queue_test_drain(test, q, c, QUEUE_TEST_SIZE));
+   KUNIT_EXPECT_EQ(test, c->next, seq + 1);
+   KUNIT_EXPECT_EQ(test, q->gapPending, 0UL);
+   KUNIT_EXPECT_TRUE(test, kfifo_is_empty(&q->fifo));
+}
+
+/// A reader that never reads: the queue keeps the oldest events and one gap record covers the rest
+static void ebbgpio_queue_test_overflow(struct kunit *test){
+   struct ebbgpio_queue *q = test->priv;
+   struct ebbgpio_queue_check c = { .next = 1 };
+   u32 seq = 0;
+   unsigned int i;
+
+   for (i = 0; i < 3 * QUEUE_TEST_SIZE; i++) ebbgpio_queue_test_push(q, &seq);
+   KUNIT_EXPECT_EQ(test, kfifo_len(&q->fifo), QUEUE_TEST_SIZE);
+   KUNIT_EXPECT_EQ(test, q->dropped, 2UL * QUEUE_TEST_SIZE);
+   ebbgpio_queue_test_settle(test, q, &c, seq);
+   KUNIT_EXPECT_EQ(test, c.gaps, q->dropped);
+}
+
+/// Random bursts against random partial reads, the accounting must hold at every point
+static void ebbgpio_queue_test_storm(struct kunit *test){
+   struct ebbgpio_queue *q = test->priv;
+   struct ebbgpio_queue_check c = { .next = 1 };
+   struct rnd_state rnd;
+   u32 seq = 0, burst;
+   unsigned int i;
+
+   prandom_seed_state(&rnd, 0xebb);
+   for (i = 0; i < 20000; i++){
+      for (burst = prandom_u32_state(&rnd) % (2 * QUEUE_TEST_SIZE); burst; burst--)
+         ebbgpio_queue_test_push(q, &seq);
+      KUNIT_ASSERT_LE(test, kfifo_len(&q->fifo), QUEUE_TEST_SIZE);
+      ebbgpio_queue_test_drain(test, q, &c, prandom_u32_state(&rnd) % (QUEUE_TEST_SIZE + 1));
+   }
+   ebbgpio_queue_test_settle(test, q, &c, seq);
+   KUNIT_EXPECT_EQ(test, c.gaps, q->dropped);
+   KUNIT_EXPECT_GT(test, q->dropped, 0UL);
+}
+
+/** @brief A consumer that resyncs during the storm
+ *  A flushing resync drops the backlog and any unreported gap, the consumer carries on from the
+ *  snapshot. A plain one leaves the queue alone. The dropped count reported always matches.
+ */
+static void ebbgpio_queue_test_resync(struct kunit *test){
+   struct ebbgpio_queue *q = test->priv;
+   struct ebbgpio_queue_check c = { .next = 1 };
+   struct ebbgpio_resync r, __user *ur;
+   struct rnd_state rnd;
+   unsigned long uaddr;
+   unsigned int i, len;
+   u32 seq = 0, burst;
+
+   uaddr = kunit_vm_mmap(test, NULL, 0, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0);
+   KUNIT_ASSERT_NE_MSG(test, uaddr, 0UL, "no user memory for the resync argument");
+   ur = (struct ebbgpio_resync __user *)uaddr;
+
+   memset(&r, 0, sizeof(r));
+   r.flags = ~EBBGPIO_RESYNC_FLUSH;
+   KUNIT_ASSERT_EQ(test, copy_to_user(ur, &r, sizeof(r)), 0UL);
+   KUNIT_EXPECT_EQ(test, ebbgpio_queue_resync(q, ur), -EINVAL);
+
+   prandom_seed_state(&rnd, 0x5eed);
+   for (i = 0; i < 5000; i++){
+      for (burst = prandom_u32_state(&rnd) % (2 * QUEUE_TEST_SIZE); burst; burst--)
+         ebbgpio_queue_test_push(q, &seq);
+      ebbgpio_queue_test_drain(test, q, &c, prandom_u32_state(&rnd) % 3);
+      if (i % 7) continue;
+      memset(&r, 0, sizeof(r));
+      r.flags = i % 2 ? EBBGPIO_RESYNC_FLUSH : 0;
+      len = kfifo_len(&q->fifo);
+      KUNIT_ASSERT_EQ(test, copy_to_user(ur, &r, sizeof(r)), 0UL);
+      KUNIT_ASSERT_EQ(test, ebbgpio_queue_resync(q, ur), 0L);
+      KUNIT_ASSERT_EQ(test, copy_from_user(&r, ur, sizeof(r)), 0UL);
+      KUNIT_EXPECT_EQ(test, r.dropped, (u64)q->dropped);
+      if (i % 2){
+         KUNIT_EXPECT_TRUE(test, kfifo_is_empty(&q->fifo));
+         KUNIT_EXPECT_EQ(test, q->gapPending, 0UL);
+         c.next = seq + 1;                  // Everything so far is covered by the snapshot
+      }
+      else KUNIT_EXPECT_EQ(test, kfifo_len(&q->fifo), len);
+   }
+   c.gaps = 0;
+   ebbgpio_queue_test_settle(test, q, &c, seq);
+}
+
+static struct kunit_case ebbgpio_queue_test_cases[] = {
+   KUNIT_CASE(ebbgpio_queue_test_overflow),
+   KUNIT_CASE(ebbgpio_queue_test_storm),
+   KUNIT_CASE(ebbgpio_queue_test_resync),
+   {}
+};
+
+static struct kunit_suite ebbgpio_queue_test_suite = {
+   .name = "ebbgpio-queue",
+   .init = ebbgpio_queue_test_init,
+   .exit = ebbgpio_queue_test_exit,
+   .test_cases = ebbgpio_queue_test_cases,
+};
+
+kunit_test_suites(&ebbgpio_pwm_test_suite, &ebbgpio_queue_test_suite);
@@ -0,0 +1,1103 @@
+/**
+ * @file   ebbgpioctl.c
+ * @author Sonu Verma
+ * @brief  User-space companion tool for the BBB LED/button driver (/dev/ebbgpio)
+ *
+ *  Build with "make tools". Run without arguments for the list of commands.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <endian.h>
+#include "ebbgpio.h"
+
+/* The kernel names ebbgpio_instance.h uses, so bench-layout times the driver's own struct */
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef struct { int counter; } atomic_t;
+#define __rcu
+#define ____cacheline_aligned_in_smp __attribute__((aligned(64)))
+#include "ebbgpio_instance.h"
+
+#define DEVICE "/dev/ebbgpio"
+#define PARAMS "/sys/module/BeagleBone_LED_Button/parameters/"
+#define VLC_DEVICE "/dev/ebbvlc"
+
+static const char *const lineNames[EBBGPIO_NUM_LINES] = {
+   [EBBGPIO_LINE_RED]    = "red",
+   [EBBGPIO_LINE_GREEN]  = "green",
+   [EBBGPIO_LINE_BUTTON] = "button",
+};
+
+/** @brief Parse a comma separated list of line names into a line bitmask
+ *  @return the bitmask, 0 if a name is unknown
+ */
+static uint64_t parse_lines(const char *list){
+   char buf[256], *tok, *save;
+   uint64_t lines = 0;
+   unsigned int i;
+
+   snprintf(buf, sizeof(buf), "%s", list);
+   for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)){
+      for (i = 0; i < EBBGPIO_NUM_LINES; i++){
+         if (lineNames[i] && strcmp(tok, lineNames[i]) == 0) break;
+      }
+      if (i == EBBGPIO_NUM_LINES){
+         fprintf(stderr, "unknown line '%s'\n", tok);
+         return 0;
+      }
+      lines |= 1ULL << i;
+   }
+   return lines;
+}
+
+/** @brief Number of valid records in the capture ring */
+static uint32_t capture_records(const struct ebbgpio_capture_header *hdr){
+   return hdr->flags & EBBGPIO_CAPTURE_WRAPPED ? hdr->num_records : hdr->head;
+}
+
+/** @brief Write the captured records as a Value Change Dump
+ *  VCD is read by sigrok (sigrok-cli -I vcd, PulseView) and most other waveform viewers. Only
+ *  the level changes are written, with a 1 ns timescale. Once the ring has wrapped the oldest
+ *  retained record does not start at sample 0, so times count back from the total sample count.
+ *  @return 0 if successful
+ */
+static int write_vcd(FILE *out, const struct ebbgpio_capture_header *hdr, const uint32_t *recs){
+   uint32_t mask = hdr->num_records - 1, count = capture_records(hdr), first = hdr->head - count;
+   uint64_t sample = hdr->samples, n;
+   uint32_t rec, levels, prev = 0;
+   unsigned int line, bit, nlines = 0;
+   unsigned char ids[EBBGPIO_CAPTURE_MAX_LINES];
+
+   fprintf(out, "$comment ebbgpio capture, %u Hz, %llu overruns $end\n",
+           hdr->rate_hz, (unsigned long long)hdr->overruns);
+   fprintf(out, "$timescale 1 ns $end\n$scope module ebbgpio $end\n");
+   for (line = 0; line < EBBGPIO_NUM_LINES; line++){
+      if (!(hdr->lines & (1ULL << line))) continue;
+      ids[nlines] = '!' + nlines;
+      fprintf(out, "$var wire 1 %c %s $end\n", ids[nlines], lineNames[line]);
+      nlines++;
+   }
+   fprintf(out, "$upscope $end\n$enddefinitions $end\n");
+
+   for (n = 0; n < count; n++) sample -= EBBGPIO_CAPTURE_RUN(recs[(first + n) & mask]);
+   for (n = 0; n < count; n++){
+      rec = recs[(first + n) & mask];
+      levels = EBBGPIO_CAPTURE_LEVELS(rec);
+      if (n == 0 || levels != prev){
+         fprintf(out, "#%llu\n", (unsigned long long)(sample * 1000000000ULL / hdr->rate_hz));
+         for (bit = 0; bit < nlines; bit++){
+            if (n == 0 || ((levels ^ prev) & (1U << bit)))
+               fprintf(out, "%u%c\n", (levels >> bit) & 1, ids[bit]);
+         }
+      }
+      prev = levels;
+      sample += EBBGPIO_CAPTURE_RUN(rec);
+   }
+   fprintf(out, "#%llu\n", (unsigned long long)(sample * 1000000000ULL / hdr->rate_hz));
+   return ferror(out) ? -1 : 0;
+}
+
+/** @brief capture LINES RATE SECONDS FILE: sample lines for a while and export them to FILE */
+static int cmd_capture(int fd, int argc, char **argv){
+   struct ebbgpio_capture cap = { 0 };
+   struct ebbgpio_capture_header *hdr;
+   size_t size;
+   FILE *out;
+   int ret;
+
+   if (argc != 4) return -EINVAL;
+   cap.lines = parse_lines(argv[0]);
+   cap.rate_hz = strtoul(argv[1], NULL, 0);
+   if (!cap.lines || !cap.rate_hz) return -EINVAL;
+
+   hdr = mmap(NULL, sizeof(*hdr), PROT_READ, MAP_SHARED, fd, 0);
+   if (hdr == MAP_FAILED) return -errno;
+   size = sizeof(*hdr) + (size_t)hdr->num_records * sizeof(uint32_t);
+   munmap(hdr, sizeof(*hdr));
+   hdr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+   if (hdr == MAP_FAILED) return -errno;
+
+   if (ioctl(fd, EBBGPIO_IOC_CAPTURE, &cap)) return -errno;
+   sleep(strtoul(argv[2], NULL, 0));
+   cap.rate_hz = 0;
+   if (ioctl(fd, EBBGPIO_IOC_CAPTURE, &cap)) return -errno;
+
+   if (hdr->flags & EBBGPIO_CAPTURE_WRAPPED)
+      fprintf(stderr, "capture wrapped, keeping the newest %u records\n", hdr->num_records);
+   fprintf(stderr, "%llu samples in %u records, %llu overruns\n", (unsigned long long)hdr->samples,
+           capture_records(hdr), (unsigned long long)hdr->overruns);
+   out = fopen(argv[3], "w");
+   if (!out) return -errno;
+   ret = write_vcd(out, hdr, (const uint32_t *)(hdr + 1));
+   if (fclose(out)) ret = -errno;
+   munmap(hdr, size);
+   return ret;
+}
+
+/// zlib CRC-32, bitwise since the blobs are tiny
+static uint32_t crc32(const uint8_t *p, size_t len){
+   uint32_t crc = ~0U;
+   int k;
+
+   while (len--){
+      crc ^= *p++;
+      for (k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xedb88320U & -(crc & 1));
+   }
+   return ~crc;
+}
+
+/** @brief Append one record with its padding to a blob under construction
+ *  @return the new length of the records area
+ */
+static size_t blob_add(uint8_t *buf, size_t used, size_t cap, uint16_t tag, const void *payload, uint16_t len){
+   struct ebbgpio_blob_record rec = { .tag = htole16(tag), .length = htole16(len) };
+   size_t padded = (len + 3) & ~3U;
+
+   if (used + sizeof(rec) + padded > cap) return 0;
+   memcpy(buf + used, &rec, sizeof(rec));
+   memset(buf + used + sizeof(rec), 0, padded);
+   memcpy(buf + used + sizeof(rec), payload, len);
+   return used + sizeof(rec) + padded;
+}
+
+/** @brief Parse a mode name
+ *  @return the enum ebbgpio_mode, -1 for an unknown name
+ */
+static int parse_mode(const char *name){
+   if (strcmp(name, "off") == 0) return EBBGPIO_MODE_OFF;
+   if (strcmp(name, "on") == 0) return EBBGPIO_MODE_ON;
+   if (strcmp(name, "flash") == 0) return EBBGPIO_MODE_FLASH;
+   return -1;
+}
+
+/** @brief Parse a pattern frame written MS:LEDS, LEDS is a combination of r and g or - for none
+ *  @return 0 if successful, -EINVAL otherwise
+ */
+static int parse_frame(const char *text, struct ebbgpio_frame *f){
+   char *leds;
+
+   memset(f, 0, sizeof(*f));
+   f->duration_ms = strtoul(text, &leds, 0);
+   if (*leds++ != ':') return -EINVAL;
+   for (; *leds; leds++){
+      if (*leds == 'r') f->leds |= 1U << EBBGPIO_LINE_RED;
+      else if (*leds == 'g') f->leds |= 1U << EBBGPIO_LINE_GREEN;
+      else if (*leds != '-') return -EINVAL;
+   }
+   return 0;
+}
+
+/** @brief compile IN.txt OUT.bin: turn a text description into a configuration blob
+ *  One setting per line, '#' starts a comment:
+ *    mode off|on|flash
+ *    period MS
+ *    slack red|green US
+ *    idle SECONDS [off|on|flash [PERIOD_MS]]
+ *    pattern ID [play] MS:LEDS ...
+ *    request CLIENT PRIORITY off|on|flash [PERIOD_MS [TIMEOUT_MS]]
+ *  mode, period and slack make up the one configuration record, which comes first. The other
+ *  lines become records of their own, applied in the order they are written.
+ */
+static int cmd_compile(int argc, char **argv){
+   struct ebbgpio_config cfg = { .mode = EBBGPIO_MODE_FLASH, .blink_period_ms = 1000 };
+   struct ebbgpio_blob_header hdr;
+   static uint8_t recs[65536], more[65536];
+   struct {
+      struct ebbgpio_blob_pattern hdr;
+      struct ebbgpio_frame frames[EBBGPIO_PATTERN_MAX_FRAMES];
+   } pat;
+   struct ebbgpio_blob_idle idle;
+   struct ebbgpio_request req;
+   char line[4096], *tok[2 + EBBGPIO_PATTERN_MAX_FRAMES], *save;
+   unsigned int lineno = 0, num = 1, i, first;
+   size_t used = 0, moreUsed = 0;
+   FILE *in, *out;
+   int n, mode;
+
+   if (argc != 2) return -EINVAL;
+   in = fopen(argv[0], "r");
+   if (!in) return -errno;
+   while (fgets(line, sizeof(line), in)){
+      lineno++;
+      if (strchr(line, '#')) *strchr(line, '#') = '\0';
+      n = 0;
+      for (tok[0] = strtok_r(line, " \t\r\n", &save); tok[n]; tok[n] = strtok_r(NULL, " \t\r\n", &save)){
+         if (++n == (int)(sizeof(tok) / sizeof(tok[0]))) goto bad;
+      }
+      if (n == 0) continue;
+      if (n == 2 && strcmp(tok[0], "mode") == 0){
+         if ((mode = parse_mode(tok[1])) < 0) goto bad;
+         cfg.mode = mode;
+      } else if (n == 2 && strcmp(tok[0], "period") == 0){
+         cfg.blink_period_ms = strtoul(tok[1], NULL, 0);
+         if (!cfg.blink_period_ms) goto bad;
+      } else if (n == 3 && strcmp(tok[0], "slack") == 0){
+         if (strcmp(tok[1], "red") == 0) cfg.slack_us[EBBGPIO_LINE_RED] = strtoul(tok[2], NULL, 0);
+         else if (strcmp(tok[1], "green") == 0) cfg.slack_us[EBBGPIO_LINE_GREEN] = strtoul(tok[2], NULL, 0);
+         else goto bad;
+      } else if (n >= 2 && n <= 4 && strcmp(tok[0], "idle") == 0){
+         mode = n > 2 ? parse_mode(tok[2]) : EBBGPIO_MODE_OFF;
+         idle.timeout_s = htole32(strtoul(tok[1], NULL, 0));
+         idle.mode = htole32(mode);
+         idle.blink_period_ms = htole32(n > 3 ? strtoul(tok[3], NULL, 0) : 6000);
+         if (mode < 0 || !idle.blink_period_ms) goto bad;
+         moreUsed = blob_add(more, moreUsed, sizeof(more), EBBGPIO_BLOB_IDLE, &idle, sizeof(idle));
+         if (!moreUsed) goto big;
+         num++;
+      } else if (n >= 3 && strcmp(tok[0], "pattern") == 0){
+         first = strcmp(tok[2], "play") == 0 ? 3 : 2;
+         pat.hdr.id = htole32(strtoul(tok[1], NULL, 0));
+         pat.hdr.flags = htole32(first == 3 ? EBBGPIO_BLOB_PATTERN_PLAY : 0);
+         if (!pat.hdr.id || (unsigned int)n == first || n - first > EBBGPIO_PATTERN_MAX_FRAMES) goto bad;
+         for (i = first; i < (unsigned int)n; i++){
+            if (parse_frame(tok[i], &pat.frames[i - first]) || !pat.frames[i - first].duration_ms) goto bad;
+            pat.frames[i - first].duration_ms = htole16(pat.frames[i - first].duration_ms);
+         }
+         moreUsed = blob_add(more, moreUsed, sizeof(more), EBBGPIO_BLOB_PATTERN, &pat,
+                             sizeof(pat.hdr) + (n - first) * sizeof(pat.frames[0]));
+         if (!moreUsed) goto big;
+         num++;
+      } else if (n >= 4 && n <= 6 && strcmp(tok[0], "request") == 0){
+         mode = parse_mode(tok[3]);
+         req.client = htole32(strtoul(tok[1], NULL, 0));
+         req.priority = htole32(strtoul(tok[2], NULL, 0));
+         req.mode = htole32(mode);
+         req.blink_period_ms = htole32(n > 4 ? strtoul(tok[4], NULL, 0) : 1000);
+         req.timeout_ms = htole32(n > 5 ? strtoul(tok[5], NULL, 0) : 0);
+         req.flags = 0;
+         if (mode < 0 || le32toh(req.client) < EBBGPIO_CLIENT_FIRST_APP || le32toh(req.client) >= EBBGPIO_MAX_CLIENTS ||
+             le32toh(req.priority) > EBBGPIO_MAX_PRIORITY || !req.blink_period_ms)
+            goto bad;
+         moreUsed = blob_add(more, moreUsed, sizeof(more), EBBGPIO_BLOB_REQUEST, &req, sizeof(req));
+         if (!moreUsed) goto big;
+         num++;
+      } else goto bad;
+   }
+   fclose(in);
+
+   cfg.mode = htole32(cfg.mode);
+   cfg.blink_period_ms = htole32(cfg.blink_period_ms);
+   for (i = 0; i < 2; i++) cfg.slack_us[i] = htole32(cfg.slack_us[i]);
+   used = blob_add(recs, used, sizeof(recs), EBBGPIO_BLOB_CONFIG, &cfg, sizeof(cfg));
+   if (!used || used + moreUsed > sizeof(recs)) return -E2BIG;
+   memcpy(recs + used, more, moreUsed);
+   used += moreUsed;
+
+   hdr.magic = htole32(EBBGPIO_BLOB_MAGIC);
+   hdr.version = htole16(EBBGPIO_BLOB_VERSION);
+   hdr.num_records = htole16(num);
+   hdr.length = htole32(used);
+   hdr.crc32 = htole32(crc32(recs, used));
+   out = fopen(argv[1], "wb");
+   if (!out) return -errno;
+   fwrite(&hdr, sizeof(hdr), 1, out);
+   fwrite(recs, used, 1, out);
+   return fclose(out) ? -errno : 0;
+
+big:
+   fclose(in);
+   return -E2BIG;
+bad:
+   fprintf(stderr, "%s:%u: cannot parse '%s'\n", argv[0], lineno, tok[0]);
+   fclose(in);
+   return -EINVAL;
+}
+
+/// Declare a field of the same name and type as in struct ebb_instance
+#define EBB_FIELD(f) __typeof__(((struct ebb_instance *)0)->f) f
+/// Cache line of a field of struct ebb_instance
+#define EBB_LINE(f) (offsetof(struct ebb_instance, f) / 64)
+
+/** @brief struct ebb_instance as it was before the grouping
+ *  The hot fields sit side by side as the old globals did, and the rest keeps the same size, so
+ *  both layouts have the same memory footprint and only the sharing differs.
+ */
+struct bench_packed {
+   EBB_FIELD(numberPresses);			// button IRQ
+   EBB_FIELD(lastInput);			// button IRQ
+   EBB_FIELD(blinkWakeups);			// LED thread
+   EBB_FIELD(ledOn);				// LED thread
+   EBB_FIELD(mode);				// read by both
+   EBB_FIELD(blinkPeriod);			// read by both
+   char cold[sizeof(struct ebb_instance) - 64];
+} __attribute__((aligned(64)));
+
+_Static_assert(sizeof(struct bench_packed) == sizeof(struct ebb_instance), "both layouts must take the same memory");
+_Static_assert(offsetof(struct bench_packed, cold) <= 64, "the packed hot fields must share one line");
+_Static_assert(EBB_LINE(numberPresses) != EBB_LINE(blinkWakeups) && EBB_LINE(lastInput) != EBB_LINE(ledOn) &&
+               EBB_LINE(numberPresses) != EBB_LINE(mode) && EBB_LINE(blinkWakeups) != EBB_LINE(blinkPeriod),
+               "struct ebb_instance must keep the IRQ, LED thread and read-mostly fields on separate lines");
+
+struct bench_arg {
+   void *insts;
+   int split, led, cpu;
+   unsigned long n, iters;
+   pthread_barrier_t *start;
+};
+
+/** @brief One side of the layout benchmark: the IRQ writer or the LED thread, for every instance in turn */
+static void *bench_layout_run(void *p){
+   struct bench_arg *a = p;
+   struct bench_packed *pk = a->insts;
+   struct ebb_instance *sp = a->insts;
+   unsigned long i, k;
+   cpu_set_t set;
+
+   CPU_ZERO(&set);
+   CPU_SET(a->cpu, &set);
+   pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+   pthread_barrier_wait(a->start);
+   for (i = 0; i < a->iters; i++){
+      for (k = 0; k < a->n; k++){
+         if (a->split && a->led){
+            __atomic_store_n(&sp[k].blinkWakeups, sp[k].blinkWakeups + 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&sp[k].ledOn, !sp[k].ledOn ^ !__atomic_load_n(&sp[k].mode, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+         } else if (a->split){
+            __atomic_store_n(&sp[k].numberPresses, sp[k].numberPresses + 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&sp[k].lastInput, i + __atomic_load_n(&sp[k].blinkPeriod, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+         } else if (a->led){
+            __atomic_store_n(&pk[k].blinkWakeups, pk[k].blinkWakeups + 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&pk[k].ledOn, !pk[k].ledOn ^ !__atomic_load_n(&pk[k].mode, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+         } else {
+            __atomic_store_n(&pk[k].numberPresses, pk[k].numberPresses + 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&pk[k].lastInput, i + __atomic_load_n(&pk[k].blinkPeriod, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+         }
+      }
+   }
+   return NULL;
+}
+
+/** @brief Time the IRQ writer and LED thread updating N instances in one layout
+ *  @return ns per update, negative errno on failure
+ */
+static double bench_layout_time(int split, unsigned long n, unsigned long iters, int cpus[2]){
+   size_t size = split ? sizeof(struct ebb_instance) : sizeof(struct bench_packed);
+   struct bench_arg args[2];
+   pthread_barrier_t start;
+   pthread_t tid[2];
+   struct timespec t0, t1;
+   void *insts;
+   int i;
+
+   if (posix_memalign(&insts, 64, n * size)) return -ENOMEM;
+   memset(insts, 0, n * size);
+   pthread_barrier_init(&start, NULL, 3);
+   for (i = 0; i < 2; i++){
+      args[i] = (struct bench_arg){ .insts = insts, .split = split, .led = i, .cpu = cpus[i],
+                                    .n = n, .iters = iters, .start = &start };
+      pthread_create(&tid[i], NULL, bench_layout_run, &args[i]);
+   }
+   pthread_barrier_wait(&start);
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for (i = 0; i < 2; i++) pthread_join(tid[i], NULL);
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   pthread_barrier_destroy(&start);
+   free(insts);
+   return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / ((double)n * iters);
+}
+
+/** @brief Show what grouping struct ebb_instance by writer saves when many instances are busy
+ *
+ *  Runs without the device: one thread plays the button IRQ and another the LED thread, each on
+ *  its own CPU, updating N instances laid out the way the driver's globals used to be and as the
+ *  real struct ebb_instance from ebbgpio_instance.h. Run it under "perf c2c record" to see the
+ *  HITM lines go.
+ */
+static int cmd_bench_layout(int argc, char **argv){
+   unsigned long n, iters;
+   int cpus[2] = { 0, 1 };
+   double packed, split;
+
+   if (argc < 1 || argc > 2) return -EINVAL;
+   n = strtoul(argv[0], NULL, 0);
+   iters = argc > 1 ? strtoul(argv[1], NULL, 0) : 20000000UL / (n ? n : 1);
+   if (!n || !iters) return -EINVAL;
+   if (sysconf(_SC_NPROCESSORS_ONLN) < 2) fprintf(stderr, "only one CPU online, there is no sharing to measure\n");
+   packed = bench_layout_time(0, n, iters, cpus);
+   split = bench_layout_time(1, n, iters, cpus);
+   if (packed < 0 || split < 0) return -ENOMEM;
+   printf("instances %lu, %lu updates each per writer\n", n, iters);
+   printf("instance %zu bytes, hot fields on lines %zu/%zu/%zu when grouped\n", sizeof(struct ebb_instance),
+          EBB_LINE(numberPresses), EBB_LINE(blinkWakeups), EBB_LINE(mode));
+   printf("packed  %.2f ns/update\n", packed);
+   printf("grouped %.2f ns/update  (%.1fx)\n", split, packed / split);
+   return 0;
+}
+
+/** @brief stats: print the driver counters and the memory per LED instance
+ *  The pattern library is shared, so n instances cost n times instance_bytes plus the library once.
+ */
+static int cmd_stats(int fd, int argc){
+   static const unsigned int instances[] = { 1, 64, 1024 };
+   struct ebbgpio_stats s;
+   unsigned int i;
+
+   if (argc != 0) return -EINVAL;
+   if (ioctl(fd, EBBGPIO_IOC_GET_STATS, &s)) return -errno;
+   printf("presses %llu events dropped %llu LED wake ups %llu idle entries %llu\n",
+          (unsigned long long)s.presses, (unsigned long long)s.events_dropped,
+          (unsigned long long)s.blink_wakeups, (unsigned long long)s.idle_entries);
+   printf("strip %llu frames, last %llu us wall %llu us CPU, %llu us mean wall %llu us mean CPU\n",
+          (unsigned long long)s.strip_frames, (unsigned long long)s.strip_frame_ns / 1000,
+          (unsigned long long)s.strip_cpu_ns / 1000,
+          (unsigned long long)(s.strip_frames ? s.strip_frame_ns_total / s.strip_frames / 1000 : 0),
+          (unsigned long long)(s.strip_frames ? s.strip_cpu_ns_total / s.strip_frames / 1000 : 0));
+   printf("vlc tx frames %llu rx frames %llu rx errors %llu rx dropped %llu\n",
+          (unsigned long long)s.vlc_tx_frames, (unsigned long long)s.vlc_rx_frames,
+          (unsigned long long)s.vlc_rx_errors, (unsigned long long)s.vlc_rx_dropped);
+   printf("instance %u bytes, pattern library %u patterns %llu bytes\n", s.instance_bytes, s.patterns,
+          (unsigned long long)s.pattern_bytes);
+   for (i = 0; i < sizeof(instances) / sizeof(instances[0]); i++)
+      printf("%5u instances %10llu bytes\n", instances[i],
+             (unsigned long long)instances[i] * s.instance_bytes + s.pattern_bytes);
+   return 0;
+}
+
+/** @brief timing: print the blink deadline counters and the lateness histogram */
+static int cmd_timing(int fd, int argc){
+   static const char *const policies[] = { "skip", "catchup", "degrade" };
+   struct ebbgpio_timing t;
+   unsigned int i;
+
+   if (argc != 0) return -EINVAL;
+   if (ioctl(fd, EBBGPIO_IOC_GET_TIMING, &t)) return -errno;
+   printf("deadlines %llu misses %llu skipped %llu worst %llu ns mean miss %llu ns\n",
+          (unsigned long long)t.deadlines, (unsigned long long)t.misses, (unsigned long long)t.skipped,
+          (unsigned long long)t.late_max_ns,
+          (unsigned long long)(t.misses ? t.late_total_ns / t.misses : 0));
+   printf("overrun %s, rate 1/%u\n", t.overrun < 3 ? policies[t.overrun] : "?", 1U << t.degrade_shift);
+   for (i = 0; i < EBBGPIO_LATE_BUCKETS; i++){
+      if (!t.late_hist[i]) continue;
+      if (i == 0) printf("        < 1 us %llu\n", (unsigned long long)t.late_hist[i]);
+      else printf("%6u-%u us %llu\n", 1U << (i - 1), (1U << i) - 1, (unsigned long long)t.late_hist[i]);
+   }
+   return 0;
+}
+
+/** @brief touch: print the touch pad charge times, baselines and scan cost */
+static int cmd_touch(int fd, int argc){
+   struct ebbgpio_touch t;
+   unsigned int i;
+
+   if (argc != 0) return -EINVAL;
+   if (ioctl(fd, EBBGPIO_IOC_GET_TOUCH, &t)) return -errno;
+   if (!t.num_pads){
+      fprintf(stderr, "touch sensing is off, load the module with touchSense=1\n");
+      return -ENODEV;
+   }
+   printf("%llu scans at %u Hz, %llu ns mean %llu ns worst per scan, last touch seen within %llu us\n",
+          (unsigned long long)t.scans, t.scan_hz,
+          (unsigned long long)(t.scans ? t.scan_ns_total / t.scans : 0), (unsigned long long)t.scan_ns_max,
+          (unsigned long long)t.latency_ns / 1000);
+   for (i = 0; i < t.num_pads; i++)
+      printf("pad %u: %s raw %u baseline %u.%02u\n", i, (t.touched >> i) & 1 ? "touched " : "released",
+             t.raw[i], t.baseline[i] >> 8, (t.baseline[i] & 0xff) * 100 / 256);
+   return 0;
+}
+
+/** @brief range: print the ultrasonic distances, measurement rate and trigger timing error */
+static int cmd_range(int fd, int argc){
+   struct ebbgpio_range r;
+   unsigned int i;
+
+   if (argc != 0) return -EINVAL;
+   if (ioctl(fd, EBBGPIO_IOC_GET_RANGE, &r)) return -errno;
+   if (!r.num_sensors){
+      fprintf(stderr, "no ultrasonic sensors, load the module with sonarTrig= and sonarEcho=\n");
+      return -ENODEV;
+   }
+   printf("%u sensors, %.2f Hz each, %llu triggers, late by %llu ns mean %llu ns worst, pulse %llu ns worst, %llu stray edges\n",
+          r.num_sensors, 1000.0 / (r.slot_ms * r.num_sensors), (unsigned long long)r.triggers,
+          (unsigned long long)(r.triggers ? r.trigger_late_ns_total / r.triggers : 0),
+          (unsigned long long)r.trigger_late_ns_max, (unsigned long long)r.pulse_ns_max,
+          (unsigned long long)r.stray_edges);
+   for (i = 0; i < r.num_sensors; i++)
+      printf("sensor %u: %u mm (echo %u ns), %llu good, %llu timeouts\n", i, r.sensor[i].distance_mm,
+             r.sensor[i].echo_ns, (unsigned long long)r.sensor[i].measurements,
+             (unsigned long long)r.sensor[i].timeouts);
+   return 0;
+}
+
+/** @brief latency: print the latency quantiles and the SLO state */
+static int cmd_latency(int fd, int argc){
+   static const char *const names[EBBGPIO_LAT_NUM] = {
+      [EBBGPIO_LAT_EDGE]  = "button to LED",
+      [EBBGPIO_LAT_TIMER] = "blink lateness",
+   };
+   struct ebbgpio_latency lat;
+   struct ebbgpio_quantiles *q;
+   unsigned int i;
+
+   if (argc != 0) return -EINVAL;
+   if (ioctl(fd, EBBGPIO_IOC_GET_LATENCY, &lat)) return -errno;
+   for (i = 0; i < EBBGPIO_LAT_NUM; i++){
+      q = &lat.metric[i];
+      printf("%-14s %llu samples, p50 %llu us p99 %llu us p99.9 %llu us", names[i], (unsigned long long)q->count,
+             (unsigned long long)q->p50_ns / 1000, (unsigned long long)q->p99_ns / 1000,
+             (unsigned long long)q->p999_ns / 1000);
+      if (q->slo_us) printf(", SLO p99 %u us%s, %llu alarms", q->slo_us, q->alarmed ? " BREACHED" : "",
+                            (unsigned long long)q->alarms);
+      printf("\n");
+   }
+   return 0;
+}
+
+/** @brief pattern ID [MS:LEDS ...]: upload a pattern, LEDS is a combination of r and g or - for none
+ *  Without frames the pattern is deleted.
+ */
+static int cmd_pattern(int fd, int argc, char **argv){
+   struct ebbgpio_frame frames[EBBGPIO_PATTERN_MAX_FRAMES];
+   struct ebbgpio_pattern pat = { 0 };
+   int i;
+
+   if (argc < 1 || argc - 1 > EBBGPIO_PATTERN_MAX_FRAMES) return -EINVAL;
+   pat.id = strtoul(argv[0], NULL, 0);
+   for (i = 1; i < argc; i++){
+      if (parse_frame(argv[i], &frames[i - 1])) return -EINVAL;
+   }
+   pat.num_frames = argc - 1;
+   pat.frames = (uintptr_t)frames;
+   return ioctl(fd, EBBGPIO_IOC_PATTERN_LOAD, &pat) ? -errno : 0;
+}
+
+/** @brief play ID [PHASE_MS]: show pattern ID in FLASH mode, 0 for the plain blink */
+static int cmd_play(int fd, int argc, char **argv){
+   struct ebbgpio_pattern_play play = { 0 };
+
+   if (argc < 1 || argc > 2) return -EINVAL;
+   play.id = strtoul(argv[0], NULL, 0);
+   if (argc == 2) play.phase_ms = strtoul(argv[1], NULL, 0);
+   return ioctl(fd, EBBGPIO_IOC_PATTERN_PLAY, &play) ? -errno : 0;
+}
+
+/// A minimal io_uring, set up with the raw system calls so the tool needs no liburing
+struct uring {
+   int fd;
+   unsigned int *sqHead, *sqTail, *sqMask, *sqArray;
+   unsigned int *cqHead, *cqTail, *cqMask;
+   struct io_uring_sqe *sqes;
+   struct io_uring_cqe *cqes;
+   void *sqRing, *cqRing;
+   size_t sqSize, cqSize, sqesSize;
+};
+
+static void uring_close(struct uring *r){
+   if (r->sqes) munmap(r->sqes, r->sqesSize);
+   if (r->cqRing) munmap(r->cqRing, r->cqSize);
+   if (r->sqRing) munmap(r->sqRing, r->sqSize);
+   close(r->fd);
+}
+
+/** @brief Create a ring of the given depth and map its queues
+ *  @return 0 if successful, negative errno otherwise
+ */
+static int uring_setup(struct uring *r, unsigned int entries){
+   struct io_uring_params p;
+
+   memset(r, 0, sizeof(*r));
+   memset(&p, 0, sizeof(p));
+   r->fd = syscall(__NR_io_uring_setup, entries, &p);
+   if (r->fd < 0) return -errno;
+   r->sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+   r->cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+   r->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+   r->sqRing = mmap(NULL, r->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+   r->cqRing = mmap(NULL, r->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+   r->sqes = mmap(NULL, r->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+   if (r->sqRing == MAP_FAILED || r->cqRing == MAP_FAILED || r->sqes == MAP_FAILED){
+      int ret = -errno;
+      if (r->sqRing == MAP_FAILED) r->sqRing = NULL;
+      if (r->cqRing == MAP_FAILED) r->cqRing = NULL;
+      if (r->sqes == MAP_FAILED) r->sqes = NULL;
+      uring_close(r);
+      return ret;
+   }
+   r->sqHead = (unsigned int *)((char *)r->sqRing + p.sq_off.head);
+   r->sqTail = (unsigned int *)((char *)r->sqRing + p.sq_off.tail);
+   r->sqMask = (unsigned int *)((char *)r->sqRing + p.sq_off.ring_mask);
+   r->sqArray = (unsigned int *)((char *)r->sqRing + p.sq_off.array);
+   r->cqHead = (unsigned int *)((char *)r->cqRing + p.cq_off.head);
+   r->cqTail = (unsigned int *)((char *)r->cqRing + p.cq_off.tail);
+   r->cqMask = (unsigned int *)((char *)r->cqRing + p.cq_off.ring_mask);
+   r->cqes = (struct io_uring_cqe *)((char *)r->cqRing + p.cq_off.cqes);
+   return 0;
+}
+
+/** @brief Submit batch copies of a driver command and wait for all of them
+ *  @return 0 if every command succeeded, otherwise the first error
+ */
+static int uring_cmd_batch(struct uring *r, int fd, unsigned int cmd, void *arg, unsigned int batch){
+   struct ebbgpio_uring_cmd *ucmd;
+   struct io_uring_sqe *sqe;
+   unsigned int tail, head, i, seen = 0;
+   int ret = 0;
+
+   tail = *r->sqTail;
+   for (i = 0; i < batch; i++, tail++){
+      sqe = &r->sqes[tail & *r->sqMask];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_URING_CMD;
+      sqe->fd = fd;
+      sqe->cmd_op = cmd;
+      ucmd = (struct ebbgpio_uring_cmd *)sqe->cmd;	// Fits the 16 bytes of a normal SQE
+      ucmd->addr = (uintptr_t)arg;
+      r->sqArray[tail & *r->sqMask] = tail & *r->sqMask;
+   }
+   __atomic_store_n(r->sqTail, tail, __ATOMIC_RELEASE);
+   if (syscall(__NR_io_uring_enter, r->fd, batch, batch, IORING_ENTER_GETEVENTS, NULL, 0) < 0) return -errno;
+   head = *r->cqHead;
+   while (seen < batch){
+      if (head == __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE)){
+         if (syscall(__NR_io_uring_enter, r->fd, 0, batch - seen, IORING_ENTER_GETEVENTS, NULL, 0) < 0) return -errno;
+         continue;
+      }
+      if (r->cqes[head & *r->cqMask].res < 0 && !ret) ret = r->cqes[head & *r->cqMask].res;
+      head++;
+      seen++;
+   }
+   __atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+   return ret;
+}
+
+static double elapsed_s(const struct timespec *t0){
+   struct timespec t1;
+
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/** @brief bench-uring OPS [DEPTH]: GET_STATS through ioctl() against io_uring passthrough
+ *  The same command runs OPS times with one ioctl() per call, then through io_uring with one
+ *  command and with DEPTH commands per io_uring_enter(), so the cost of the system call itself
+ *  shows in the ops/s.
+ */
+static int cmd_bench_uring(int fd, int argc, char **argv){
+   struct ebbgpio_stats stats;
+   struct timespec t0;
+   struct uring r;
+   unsigned long ops, i;
+   unsigned int depth, batch, pass;
+   double s;
+   int ret;
+
+   if (argc < 1 || argc > 2) return -EINVAL;
+   ops = strtoul(argv[0], NULL, 0);
+   depth = argc > 1 ? strtoul(argv[1], NULL, 0) : 32;
+   if (!ops || !depth || depth > 4096) return -EINVAL;
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for (i = 0; i < ops; i++){
+      if (ioctl(fd, EBBGPIO_IOC_GET_STATS, &stats)) return -errno;
+   }
+   s = elapsed_s(&t0);
+   printf("ioctl           %10.0f ops/s  %7.0f ns/op\n", ops / s, s * 1e9 / ops);
+
+   ret = uring_setup(&r, depth);
+   if (ret) return ret;
+   for (pass = 0; pass < 2; pass++){
+      batch = pass ? depth : 1;
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      for (i = 0; i < ops && !ret; i += batch)
+         ret = uring_cmd_batch(&r, fd, EBBGPIO_IOC_GET_STATS, &stats, ops - i < batch ? ops - i : batch);
+      if (ret) break;
+      s = elapsed_s(&t0);
+      printf("io_uring x%-5u %10.0f ops/s  %7.0f ns/op\n", batch, ops / s, s * 1e9 / ops);
+   }
+   uring_close(&r);
+   return ret;
+}
+
+/// CPU time used by the process so far, user and system, in seconds
+static double cpu_s(void){
+   struct rusage ru;
+
+   getrusage(RUSAGE_SELF, &ru);
+   return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+/** @brief Move events from the device to /dev/null for a while, by read()+write() or by splice()
+ *  @return bytes moved, negative errno on failure
+ */
+static long long bench_splice_pass(int fd, int null, int pipefd[2], int useSplice, double seconds){
+   char buf[64 * sizeof(struct ebbgpio_event)];
+   struct pollfd pfd = { .fd = fd, .events = POLLIN };
+   struct timespec t0;
+   long long moved = 0;
+   double left;
+   ssize_t n, out;
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   while ((left = seconds - elapsed_s(&t0)) > 0){
+      n = poll(&pfd, 1, (int)(left * 1000) + 1);
+      if (n < 0) return -errno;
+      if (n == 0) continue;
+      if (useSplice){
+         n = splice(fd, NULL, pipefd[1], NULL, sizeof(buf), SPLICE_F_NONBLOCK);
+         for (out = 0; n > 0 && out < n; ){
+            ssize_t m = splice(pipefd[0], NULL, null, NULL, n - out, SPLICE_F_MOVE);
+            if (m <= 0) return m ? -errno : -EIO;
+            out += m;
+         }
+      }
+      else {
+         n = read(fd, buf, sizeof(buf));
+         if (n > 0 && write(null, buf, n) != n) return -errno;
+      }
+      if (n < 0 && errno != EAGAIN) return -errno;
+      if (n > 0) moved += n;
+   }
+   return moved;
+}
+
+/** @brief bench-splice SECONDS: events/s and CPU per event of read()+write() against splice()
+ *  Each method drains /dev/ebbgpio into /dev/null for SECONDS. The events come from the button
+ *  (or a signal generator on its line), so both passes need the same input rate to compare.
+ */
+static int cmd_bench_splice(int fd, int argc, char **argv){
+   static const char *const names[] = { "read+write", "splice" };
+   int null, pipefd[2], pass, ret = 0;
+   long long moved;
+   double seconds, cpu, events;
+
+   if (argc != 1) return -EINVAL;
+   seconds = strtod(argv[0], NULL);
+   if (seconds <= 0) return -EINVAL;
+   null = open("/dev/null", O_WRONLY);
+   if (null < 0) return -errno;
+   if (pipe(pipefd)){
+      ret = -errno;
+      close(null);
+      return ret;
+   }
+   for (pass = 0; pass < 2; pass++){
+      cpu = cpu_s();
+      moved = bench_splice_pass(fd, null, pipefd, pass, seconds);
+      if (moved < 0){
+         ret = moved;
+         break;
+      }
+      cpu = cpu_s() - cpu;
+      events = (double)moved / sizeof(struct ebbgpio_event);
+      printf("%-10s %10.0f events  %10.1f events/s  %8.0f ns CPU/event\n", names[pass], events,
+             events / seconds, events ? cpu * 1e9 / events : 0.0);
+   }
+   close(pipefd[0]);
+   close(pipefd[1]);
+   close(null);
+   return ret;
+}
+
+/** @brief Sample the LED thread over SECONDS
+ *  @return 0 if successful, with the wake ups per second and the missed deadlines in that time
+ */
+static int wakeups_pass(int fd, double seconds, double *rate, unsigned long long *misses){
+   struct ebbgpio_stats s0, s1;
+   struct ebbgpio_timing t0, t1;
+   struct timespec start, ts;
+   double s;
+
+   if (ioctl(fd, EBBGPIO_IOC_GET_STATS, &s0) || ioctl(fd, EBBGPIO_IOC_GET_TIMING, &t0)) return -errno;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   ts.tv_sec = (time_t)seconds;
+   ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1e9);
+   while (nanosleep(&ts, &ts) && errno == EINTR);
+   if (ioctl(fd, EBBGPIO_IOC_GET_STATS, &s1) || ioctl(fd, EBBGPIO_IOC_GET_TIMING, &t1)) return -errno;
+   s = elapsed_s(&start);
+   *rate = (s1.blink_wakeups - s0.blink_wakeups) / s;
+   *misses = t1.misses - t0.misses;
+   return 0;
+}
+
+/** @brief wakeups SECONDS [SLACK_US]: LED thread wake ups per second, with and without coalescing
+ *  With SLACK_US the rate is measured twice, once with exact toggles and once with SLACK_US of
+ *  tolerance on both LEDs, and the configuration is put back afterwards. Slack only saves wake
+ *  ups when other timers fire close to the toggles, so run it on the system as it is normally used.
+ */
+static int cmd_wakeups(int fd, int argc, char **argv){
+   struct ebbgpio_config saved, cfg;
+   unsigned long long misses;
+   unsigned int slack[2], pass;
+   double seconds, rate;
+   int ret = 0;
+
+   if (argc < 1 || argc > 2) return -EINVAL;
+   seconds = strtod(argv[0], NULL);
+   if (seconds <= 0) return -EINVAL;
+   if (argc == 1){
+      ret = wakeups_pass(fd, seconds, &rate, &misses);
+      if (!ret) printf("%.1f wakeups/s  %llu missed deadlines\n", rate, misses);
+      return ret;
+   }
+   slack[0] = 0;
+   slack[1] = strtoul(argv[1], NULL, 0);
+   if (ioctl(fd, EBBGPIO_IOC_GET_CONFIG, &saved)) return -errno;
+   for (pass = 0; pass < 2 && !ret; pass++){
+      cfg = saved;
+      cfg.slack_us[EBBGPIO_LINE_RED] = cfg.slack_us[EBBGPIO_LINE_GREEN] = slack[pass];
+      if (ioctl(fd, EBBGPIO_IOC_SET_CONFIG, &cfg)){
+         ret = -errno;
+         break;
+      }
+      ret = wakeups_pass(fd, seconds, &rate, &misses);
+      if (!ret) printf("slack %6u us  %8.1f wakeups/s  %llu missed deadlines\n", slack[pass], rate, misses);
+   }
+   if (ioctl(fd, EBBGPIO_IOC_SET_CONFIG, &saved) && !ret) ret = -errno;
+   return ret;
+}
+
+/** @brief Read or write a numeric module parameter through sysfs
+ *  @return 0 if successful, negative errno otherwise
+ */
+static int module_param_io(const char *name, unsigned int *value, int write){
+   char path[128];
+   FILE *f;
+   int ret = 0;
+
+   snprintf(path, sizeof(path), PARAMS "%s", name);
+   f = fopen(path, write ? "w" : "r");
+   if (!f) return -errno;
+   if (write) fprintf(f, "%u\n", *value);
+   else if (fscanf(f, "%u", value) != 1) ret = -EIO;
+   if (fclose(f) && !ret) ret = -errno;
+   return ret;
+}
+
+/** @brief Push a frame to the first pixels of the strip and wait until the driver has sent it
+ *  @return 0 if successful, -ETIMEDOUT when no frame went out within a second
+ */
+static int strip_push(int fd, struct ebbgpio_strip_frame *f, unsigned long long *sent){
+   struct ebbgpio_stats s;
+   struct timespec t0;
+
+   if (ioctl(fd, EBBGPIO_IOC_STRIP_FRAME, f)) return -errno;
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   do {
+      if (ioctl(fd, EBBGPIO_IOC_GET_STATS, &s)) return -errno;
+      if (s.strip_frames != *sent){
+         *sent = s.strip_frames;
+         return 0;
+      }
+      usleep(50);
+   } while (elapsed_s(&t0) < 1.0);
+   return -ETIMEDOUT;
+}
+
+/** @brief strip FRAMES [PIXELS ...]: frame rate, wall time and CPU time of the WS2812 engine
+ *  For each length (30, 144 and 300 pixels by default) the stripLength parameter is set and
+ *  FRAMES frames are pushed, each after the previous one went out, so none is merged away.
+ *  Lengths beyond stripPixels are skipped, and stripLength is put back afterwards.
+ */
+static int cmd_strip(int fd, int argc, char **argv){
+   static const unsigned int defaults[] = { 30, 144, 300 };
+   static uint8_t rgb[3 * 1024];
+   struct ebbgpio_strip_frame f = { .rgb = (uintptr_t)rgb };
+   struct ebbgpio_stats s0, s1;
+   unsigned long long sent, done;
+   unsigned int frames, pixels, saved, max, i, k, n;
+   struct timespec t0;
+   double secs;
+   int ret, restore;
+
+   if (argc < 1) return -EINVAL;
+   frames = strtoul(argv[0], NULL, 0);
+   n = argc > 1 ? argc - 1 : 3;
+   if (!frames) return -EINVAL;
+   ret = module_param_io("stripPixels", &max, 0);
+   if (!ret) ret = module_param_io("stripLength", &saved, 0);
+   if (ret) return ret;
+   for (k = 0; k < n && !ret; k++){
+      pixels = argc > 1 ? strtoul(argv[k + 1], NULL, 0) : defaults[k];
+      if (!pixels || pixels > max || pixels > sizeof(rgb) / 3){
+         printf("%4u pixels  skipped, the strip has %u\n", pixels, max);
+         continue;
+      }
+      ret = module_param_io("stripLength", &pixels, 1);
+      if (ret || ioctl(fd, EBBGPIO_IOC_GET_STATS, &s0)){
+         ret = ret ? ret : -errno;
+         break;
+      }
+      sent = s0.strip_frames;
+      f.count = pixels;
+      memset(rgb, 0, pixels * 3);
+      strip_push(fd, &f, &sent);		// Start from dark, times out if it already was
+      if (ioctl(fd, EBBGPIO_IOC_GET_STATS, &s0)){
+         ret = -errno;
+         break;
+      }
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      for (i = 0; i < frames && !ret; i++){
+         memset(rgb, i & 1 ? 0x10 : 0x20, pixels * 3);	// Never the same as the frame before
+         ret = strip_push(fd, &f, &sent);
+      }
+      secs = elapsed_s(&t0);
+      if (ret || ioctl(fd, EBBGPIO_IOC_GET_STATS, &s1)){
+         ret = ret ? ret : -errno;
+         break;
+      }
+      done = s1.strip_frames - s0.strip_frames;
+      if (!done) continue;
+      printf("%4u pixels  %6llu frames  %7.1f frames/s  wall %8.1f us/frame  CPU %8.1f us/frame  %.2f us/pixel\n",
+             pixels, done, done / secs, (s1.strip_frame_ns_total - s0.strip_frame_ns_total) / 1e3 / done,
+             (s1.strip_cpu_ns_total - s0.strip_cpu_ns_total) / 1e3 / done,
+             (s1.strip_cpu_ns_total - s0.strip_cpu_ns_total) / 1e3 / done / pixels);
+   }
+   restore = module_param_io("stripLength", &saved, 1);
+   return ret ? ret : restore;
+}
+
+/** @brief vlc-loopback BYTES [TIMEOUT_S]: send BYTES over the optical link and read them back
+ *  Needs the vlcTxLed LED facing the gpioVlcRx receiver. Byte n of the stream is n & 0xff, so a
+ *  lost frame shows up as a jump and the read side resynchronises on the next byte. Stops when
+ *  all bytes are back or nothing arrived for TIMEOUT_S (default 2) seconds, then prints the
+ *  payload throughput and the /dev/ebbvlc counters of the run.
+ */
+static int cmd_vlc_loopback(int fd, int argc, char **argv){
+   struct ebbgpio_stats s0, s1;
+   struct pollfd pfd;
+   struct timespec t0, last;
+   unsigned long long total, sent = 0, got = 0, lost = 0, frames, errors;
+   unsigned int bitUs = 0, i;
+   uint8_t tx[256], rx[256], expect = 0;
+   double timeout, secs;
+   ssize_t n;
+   int ret = 0;
+
+   if (argc < 1 || argc > 2) return -EINVAL;
+   total = strtoull(argv[0], NULL, 0);
+   timeout = argc > 1 ? strtod(argv[1], NULL) : 2.0;
+   if (!total || timeout <= 0) return -EINVAL;
+   pfd.fd = open(VLC_DEVICE, O_RDWR | O_NONBLOCK);
+   if (pfd.fd < 0) return -errno;
+   while (read(pfd.fd, rx, sizeof(rx)) > 0);		// Drop what an earlier run left behind
+   module_param_io("vlcBitUs", &bitUs, 0);
+   if (ioctl(fd, EBBGPIO_IOC_GET_STATS, &s0)){
+      ret = -errno;
+      goto out;
+   }
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   last = t0;
+   while (got + lost < total){
+      pfd.events = POLLIN | (sent < total ? POLLOUT : 0);
+      if (poll(&pfd, 1, 100) < 0 && errno != EINTR){
+         ret = -errno;
+         break;
+      }
+      if ((pfd.revents & POLLOUT) && sent < total){
+         for (i = 0; i < sizeof(tx); i++) tx[i] = (uint8_t)(sent + i);
+         n = write(pfd.fd, tx, total - sent < sizeof(tx) ? total - sent : sizeof(tx));
+         if (n < 0 && errno != EAGAIN){
+            ret = -errno;
+            break;
+         }
+         if (n > 0) sent += n;
+      }
+      if (pfd.revents & POLLIN){
+         n = read(pfd.fd, rx, sizeof(rx));
+         if (n < 0 && errno != EAGAIN){
+            ret = -errno;
+            break;
+         }
+         for (i = 0; i < (n > 0 ? n : 0); i++){
+            lost += (uint8_t)(rx[i] - expect);	// Bytes of the frames that never arrived
+            expect = rx[i] + 1;
+            got++;
+         }
+         if (n > 0) clock_gettime(CLOCK_MONOTONIC, &last);
+      }
+      if (sent == total && elapsed_s(&last) > timeout) break;
+   }
+   secs = (last.tv_sec - t0.tv_sec) + (last.tv_nsec - t0.tv_nsec) / 1e9;
+   if (!ret && ioctl(fd, EBBGPIO_IOC_GET_STATS, &s1)) ret = -errno;
+   if (ret) goto out;
+   frames = s1.vlc_rx_frames - s0.vlc_rx_frames;
+   errors = s1.vlc_rx_errors - s0.vlc_rx_errors;
+   printf("%llu of %llu bytes back in %.2f s  %.1f bytes/s", got, total, secs, secs > 0 ? got / secs : 0.0);
+   if (bitUs) printf("  (line %u bit/s)", 1000000U / bitUs);
+   printf("\n%llu bytes lost  %llu missing at the end\n", lost, total - got - lost);
+   printf("tx frames %llu  rx frames %llu  rx errors %llu  rx dropped %llu  frame error rate %.2f%%\n",
+          (unsigned long long)(s1.vlc_tx_frames - s0.vlc_tx_frames), frames, errors,
+          (unsigned long long)(s1.vlc_rx_dropped - s0.vlc_rx_dropped),
+          frames + errors ? 100.0 * errors / (frames + errors) : 0.0);
+out:
+   close(pfd.fd);
+   return ret;
+}
+
+static void usage(void){
+   fprintf(stderr,
+           "usage: ebbgpioctl COMMAND [ARGS]\n"
+           "  capture LINES RATE SECONDS FILE.vcd   sample LINES (e.g. button,red) at RATE Hz\n"
+           "  bench-layout INSTANCES [ITERATIONS]   false sharing between IRQ and LED writers, per layout\n"
+           "  compile IN.txt OUT.bin                build a boot configuration blob\n"
+           "  stats                                 driver counters, and memory for 1 64 1024 instances\n"
+           "  timing                                blink deadline misses and lateness histogram\n"
+           "  touch                                 touch pad state and scan cost\n"
+           "  range                                 ultrasonic distances and timing error\n"
+           "  latency                               latency quantiles and SLO alarms\n"
+           "  pattern ID [MS:LEDS ...]              upload (or delete) a pattern, e.g. 100:rg 400:-\n"
+           "  play ID [PHASE_MS]                    show pattern ID while flashing, 0 for the plain blink\n"
+           "  bench-uring OPS [DEPTH]               GET_STATS ops/s through ioctl() and io_uring\n"
+           "  bench-splice SECONDS                  event throughput and CPU, read()+write() against splice()\n"
+           "  wakeups SECONDS [SLACK_US]            LED thread wake ups/s, with and without SLACK_US of coalescing\n"
+           "  strip FRAMES [PIXELS ...]             WS2812 frames/s, wall and CPU time, for 30 144 300 pixels by default\n"
+           "  vlc-loopback BYTES [TIMEOUT_S]        send BYTES through /dev/ebbvlc and read them back, bytes/s and errors\n");
+}
+
+int main(int argc, char **argv){
+   int fd, ret;
+
+   if (argc < 2){
+      usage();
+      return 2;
+   }
+   if (strcmp(argv[1], "compile") == 0){
+      ret = cmd_compile(argc - 2, argv + 2);
+      goto out;
+   }
+   if (strcmp(argv[1], "bench-layout") == 0){
+      ret = cmd_bench_layout(argc - 2, argv + 2);
+      goto out;
+   }
+   fd = open(DEVICE, O_RDWR);
+   if (fd < 0){
+      perror(DEVICE);
+      return 1;
+   }
+   if (strcmp(argv[1], "capture") == 0) ret = cmd_capture(fd, argc - 2, argv + 2);
+   else if (strcmp(argv[1], "stats") == 0) ret = cmd_stats(fd, argc - 2);
+   else if (strcmp(argv[1], "timing") == 0) ret = cmd_timing(fd, argc - 2);
+   else if (strcmp(argv[1], "touch") == 0) ret = cmd_touch(fd, argc - 2);
+   else if (strcmp(argv[1], "range") == 0) ret = cmd_range(fd, argc - 2);
+   else if (strcmp(argv[1], "latency") == 0) ret = cmd_latency(fd, argc - 2);
+   else if (strcmp(argv[1], "pattern") == 0) ret = cmd_pattern(fd, argc - 2, argv + 2);
+   else if (strcmp(argv[1], "play") == 0) ret = cmd_play(fd, argc - 2, argv + 2);
+   else if (strcmp(argv[1], "strip") == 0) ret = cmd_strip(fd, argc - 2, argv + 2);
+   else if (strcmp(argv[1], "vlc-loopback") == 0) ret = cmd_vlc_loopback(fd, argc - 2, argv + 2);
+   else if (strcmp(argv[1], "wakeups") == 0) ret = cmd_wakeups(fd, argc - 2, argv + 2);
+   else if (strcmp(argv[1], "bench-uring") == 0) ret = cmd_bench_uring(fd, argc - 2, argv + 2);
+   else if (strcmp(argv[1], "bench-splice") == 0) ret = cmd_bench_splice(fd, argc - 2, argv + 2);
+   else ret = -EINVAL;
+   close(fd);
+out:
+   if (ret == -EINVAL) usage();
+   else if (ret) fprintf(stderr, "%s: %s\n", argv[1], strerror(-ret));
+   return ret ? 1 : 0;
+}